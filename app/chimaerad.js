@@ -53,17 +53,27 @@ app.controller('mainController', function($scope, $http) {
 		console.log('error');
 	}
 
-	$scope.keepalive = function() {
-		$http.post('/api/v1/keepalive', {}, {timeout:3.6e6}) // 1 hour
-			.success(function(data) {
+	$scope.events = function() {
+		// server-sent events, the browser reconnects on its own
+		var source = new EventSource('/api/v1/events');
+
+		source.onopen = function() {
+			$scope.$apply(function() {
 				$scope.connected = true;
-				success(data);
-				$scope.keepalive();
-			})
-			.error(function(data) {
+			});
+		};
+
+		source.onmessage = function(e) {
+			$scope.$apply(function() {
+				success(JSON.parse(e.data));
+			});
+		};
+
+		source.onerror = function() {
+			$scope.$apply(function() {
 				$scope.connected = false;
-				error(data);
 			});
+		};
 	}
 
 	$scope.api = function(path) {
@@ -93,14 +103,23 @@ app.controller('calibrationController', function($scope, $route, $timeout, $http
 	}
 	$scope.sensors = s;
 
-	$scope.onTimeout = function() {
-		$http.post('/api/v1/sensors', {url: device_name})
-			.success(function(data) {
-				$scope[data.key] = data.value;
-				mytimeout = $timeout($scope.onTimeout, 40);
-			})
-	}
-	var mytimeout = $timeout($scope.onTimeout, 40);
+	// sensor frames are pushed via websocket
+	var ws = new WebSocket('ws://' + location.host + '/api/v1/stream');
+
+	ws.onopen = function() {
+		ws.send(JSON.stringify({url: device_name}));
+	};
+
+	ws.onmessage = function(e) {
+		var data = JSON.parse(e.data);
+		$scope.$apply(function() {
+			$scope[data.key] = data.value;
+		});
+	};
+
+	$scope.$on('$destroy', function() {
+		ws.close();
+	});
 	
 	$scope.call = function(item, state) {
 		console.log(item, state, $scope.value[$scope.state]);
@@ -20,80 +20,148 @@ local rest_responder = require('rest_responder')
 
 local code = {
 	[200] = 'HTTP/1.1 200 OK\r\n',
-	[404] = 'HTTP/1.1 404 Not Found\r\n'
+	[404] = 'HTTP/1.1 404 Not Found\r\n',
+	[405] = 'HTTP/1.1 405 Method Not Allowed\r\n'
 }
 
 local content_type = {
-	html = 'Content-Type: text/html\r\n\r\n',
-	json = 'Content-Type: text/json\r\n\r\n',
-	css = 'Content-Type: text/css\r\n\r\n',
-	js = 'Content-Type: text/javascript\r\n\r\n',
-	png = 'Content-Type: image/png\r\n\r\n'
+	html = 'Content-Type: text/html\r\n',
+	json = 'Content-Type: text/json\r\n',
+	cbor = 'Content-Type: application/cbor\r\n',
+	css = 'Content-Type: text/css\r\n',
+	js = 'Content-Type: text/javascript\r\n',
+	png = 'Content-Type: image/png\r\n'
 }
 
 setmetatable(content_type, {
 	__index = function(self, key)
-		return 'Content-Type: application/octet-stream\r\n\r\n'
+		return 'Content-Type: application/octet-stream\r\n'
 	end})
 
-local function httpd_cb(self, client, data)
-	if(data.url == '/') then
-		data.url = '/index.html'
+-- responses are framed with Content-Length for persistent connections and
+-- handed to the client as separate parts, which are written without copying
+local function respond(client, status, suffix, body)
+	if(not body) then
+		client(code[status], 'Content-Length: 0\r\n\r\n')
+		return
+	end
+
+	client(code[status], content_type[suffix],
+		string.format('Content-Length: %i\r\n\r\n', #body), body)
+end
+
+-- quality of mime in an Accept header and how specifically it was matched
+-- (3: type/subtype, 2: type/*, 1: */*, 0: not at all), the most specific
+-- media range wins, a q of 0 refuses the type
+local function accept_q(accept, mime)
+	local major = mime:match('^[^/]+')
+	local q, spec = 0, 0
+
+	for range in accept:gmatch('[^,]+') do
+		local typ, params = range:match('^%s*([^;%s]+)%s*(.*)$')
+
+		if(typ) then
+			typ = typ:lower()
+			local s = (typ == mime and 3)
+				or (typ == major .. '/*' and 2)
+				or (typ == '*/*' and 1)
+				or 0
+
+			if(s > spec) then
+				local v = params:match(';%s*[qQ]%s*=%s*([%d%.]+)')
+				spec = s
+				q = v and tonumber(v) or 1
+			end
+		end
 	end
 
+	return q, spec
+end
+
+-- static assets are served natively by mod_http.c, which answers all GET/HEAD
+-- requests outside of the api prefix. Only api urls and other methods end up
+-- here, assets are never served through Lua, other methods on them get 405
+local function httpd_cb(self, client, data)
 	-- first search for matching path in rest api
 	if(self(data.url, client, data)) then return end
 
-	local index = data.url:find('%.[^%.]*$')
-	if(index) then
-		local file = data.url:sub(2, index-1)
-		local suffix = data.url:sub(index+1)
-
-		local chunk = ZIP.read(file .. '.' .. suffix)
-		if(chunk) then
-			client(code[200] .. content_type[suffix] .. chunk)
-		else
-			client(code[404])
-		end
+	if(data.method == 'GET' or data.method == 'HEAD'
+		or data.url:sub(1, #self.api) == self.api) then
+		respond(client, 404)
 	else
-		client(code[404])
+		client(code[405], 'Allow: GET, HEAD\r\nContent-Length: 0\r\n\r\n')
 	end
 end
 
 local httpd = rest_responder:new({
 	port = 8080,
+	timeout = 15, -- idle timeout of persistent connections in s
+	max_body = 0x100000, -- max size of buffered request bodies
+	api = '/api/', -- url prefix dispatched to Lua
+	max_age = 0, -- Cache-Control max-age of bundle assets in s, 0 revalidates via ETag
 
+	-- legacy long-poll, answered with next broadcast
 	push_client = function(self, client)
 		table.insert(self.clients, client)
 		self:_dispatch()
 	end,
 
+	-- turn client into a persistent server-sent event stream
+	push_events = function(self, client)
+		client:events()
+	end,
+
 	broadcast_json = function(self, data)
-		table.insert(self.queue, data)
-		self:_dispatch()
+		local err, str = JSON.encode(data)
+		if(err) then
+			return
+		end
+
+		self.server:publish(str)
+
+		if(#self.clients > 0) then
+			table.insert(self.queue, str)
+			self:_dispatch()
+		end
+	end,
+
+	-- whether request prefers binary CBOR over JSON replies
+	accepts_cbor = function(self, data)
+		local accept = data and data.header and data.header['accept']
+		if(not accept) then return false end
+
+		-- CBOR only when asked for explicitly and not ranked below JSON
+		local cbor, cspec = accept_q(accept, 'application/cbor')
+		local json = accept_q(accept, 'application/json')
+		return cspec == 3 and cbor > 0 and cbor >= json
+	end,
+
+	unicast_cbor = function(self, client, data)
+		local err, str = CBOR.encode(data)
+		if(not err) then
+			respond(client, 200, 'cbor', str)
+		else
+			respond(client, 200, 'cbor', select(2, CBOR.encode({status='error', message='CBOR encoding'})))
+		end
 	end,
 
 	unicast_json = function(self, client, data)
 		local err, str =  JSON.encode(data)
 		if(not err) then
-			client(code[200] .. content_type['json'] .. str)
+			respond(client, 200, 'json', str)
 		else
-			client(code[200] .. content_type['json'] .. JSON.encode({status='error', message='JSON encoding'}))
+			respond(client, 200, 'json', select(2, JSON.encode({status='error', message='JSON encoding'})))
 		end
 	end,
 
+	-- queue holds encoded items, response is built once and written to all
+	-- parked clients in C
 	_dispatch = function(self)
 		if(#self.queue>0 and #self.clients>0) then
-			local item = table.remove(self.queue, 1)
-
-			for _, client in ipairs(self.clients) do
-				local err, str = JSON.encode(item)
-				if(not err) then
-					client(code[200] .. content_type['json'] .. str)
-				else
-					client(code[200] .. content_type['json'] .. JSON.encode({status='error', message='JSON encoding'}))
-				end
-			end
+			local str = table.remove(self.queue, 1)
+
+			self.server:broadcast(self.clients, code[200], content_type.json,
+				string.format('Content-Length: %i\r\n\r\n', #str), str)
 			self.clients = {}
 		end
 	end,
@@ -103,7 +171,12 @@ local httpd = rest_responder:new({
 		self.clients = {}
 		self.server = HTTP.new(self.port, function(client, data)
 			httpd_cb(self, client, data)
-		end)
+		end, {
+			timeout = self.timeout,
+			max_body = self.max_body,
+			api = self.api,
+			max_age = self.max_age
+		})
 	end
 })
 
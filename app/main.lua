@@ -46,20 +46,44 @@ local methods = {
 	end,
 
 	dump = function(self, time, fid, blob)
+		local streams = self.streams[self.fullname]
+		if #self._sensors == 0 and not (streams and next(streams)) then
+			return true
+		end
+
+		-- pending requests, binary clients get sensors packed as int16 typed array
 		if #self._sensors > 0 then
-			sensors = {}
-			for i=1, #blob, 2 do
-				local idx = (i+1)/2
-				local val = (blob[i-1] << 8) | blob[i]
-				sensors[idx] = val > 0x800 and -(0xffff - val) or val
-			end
+			local sensors = OSC.decode_dump(blob, self._dump)
+			self._dump = sensors
 
 			for _, v in ipairs(self._sensors) do
-				v.httpd:unicast_json(v.client, {status='success', key='sensors', value=sensors})
+				if v.cbor then
+					v.httpd:unicast_cbor(v.client, {status='success', key='sensors', value=CBOR.int16(sensors)})
+				else
+					v.httpd:unicast_json(v.client, {status='success', key='sensors', value=sensors})
+				end
 			end
 			self._sensors = {}
 		end
 
+		-- push every (decimated) frame to websocket subscribers
+		if streams and next(streams) then
+			local str = nil
+
+			for ws, sub in pairs(streams) do
+				sub.count = sub.count + 1
+				if sub.count >= sub.decimate then
+					sub.count = 0
+					-- sensor array is written as JSON straight from the blob
+					str = str or '{"status":"success","key":"sensors","value":'
+						.. OSC.decode_dump(blob, 'json') .. '}'
+					if not ws:send(str) then
+						streams[ws] = nil
+					end
+				end
+			end
+		end
+
 		return true
 	end,
 
@@ -98,9 +122,10 @@ local device = osc_responder:new({
 	fullname = nil,
 	version = nil,
 	port = nil,
+	streams = nil,
+	_trie = OSC.trie(methods),
 
 	_init = function(self)
-		self._root = methods
 		self._jobs = {}
 		self._sensors = {}
 
@@ -115,8 +140,8 @@ local device = osc_responder:new({
 
 		-- create OSC responders
 		self.io = {
-			conf = OSC.new(self.url.conf, self),
-			data = OSC.new(self.url.data, self)
+			conf = self:open(self.url.conf),
+			data = self:open(self.url.data)
 		}
 	end,
 
@@ -153,6 +178,7 @@ local app = class:new({
 	_init = function(self)
 		self.discover = {}
 		self.devices = {}
+		self.streams = {}
 
 		-- HTTPD
 		self.httpd = httpd:new({
@@ -163,6 +189,10 @@ local app = class:new({
 					httpd:push_client(client)
 				end,
 
+				events = function(httpd, client)
+					httpd:push_events(client)
+				end,
+
 				interfaces = function(httpd, client)
 					httpd:unicast_json(client, {status='success', key='interfaces', value=IFACE.list()})
 				end,
@@ -223,8 +253,35 @@ local app = class:new({
 
 					table.insert(dev._sensors, {
 						httpd = httpd,
-						client = client
+						client = client,
+						cbor = httpd:accepts_cbor(data)
 					})
+				end,
+
+				-- websocket, subscribe with {url=..., decimate=...}
+				stream = function(httpd, client, data)
+					local ok = client:upgrade(function(ws, msg)
+						if not msg then -- disconnected
+							for _, streams in pairs(self.streams) do
+								streams[ws] = nil
+							end
+							return
+						end
+
+						local err, j = JSON.decode(msg)
+						if err or type(j) ~= 'table' or type(j.url) ~= 'string' then return end
+
+						-- a bad value must not break the dump loop of other subscribers
+						self.streams[j.url] = self.streams[j.url] or {}
+						self.streams[j.url][ws] = {
+							decimate = math.max(1, math.floor(tonumber(j.decimate) or 1)),
+							count = 0
+						}
+					end)
+
+					if not ok then
+						httpd:unicast_json(client, {status='error', value='websocket upgrade failed'})
+					end
 				end
 			} } }
 		})
@@ -242,7 +299,8 @@ local app = class:new({
 				local dev = device:new({
 					fullname = k,
 					version = v.version,
-					port = v.port
+					port = v.port,
+					streams = self.streams
 				})
 				self.devices[k] = dev
 			end
@@ -18,17 +18,15 @@
 local class = require('class')
 
 local osc_responder = class:new({
-	_call = function(self, time, path, fmt, ...)
-		local root = self._root
+	-- native method trie compiled with OSC.trie, patterns are matched in C
+	_trie = nil,
+	-- pass message views instead of decoded arguments
+	_lazy = false,
+	-- handler(self, time, views) receiving whole bundles as one frame
+	_frame = nil,
 
-		--print(path, fmt, ...)
-
-		for key in string.gmatch(path, '/([^/]+)') do
-			--TODO implement wildcard
-			root = root and root[key]
-		end
-
-		return root and not root(self, time, ...)
+	open = function(self, url)
+		return OSC.new(url, self, self._trie, self._lazy, self._frame)
 	end
 })
 
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <inttypes.h>
 
 // include main header
 #include <chimaerad.h>
@@ -40,10 +41,52 @@
 #endif
 
 #define AREA_SIZE 0x2000000UL // 32MB TODO increase dynamically
+#define PATH_LEN 512
+
+// directory of precompiled module bytecode, empty if unavailable
+static char bytecode_dir [PATH_LEN];
+
+#if defined(EMBED_BUNDLE)
+// generated from app.zip at build time
+extern const uint8_t app_zip [];
+extern const size_t app_zip_size;
+
+static struct zip *
+_zip_open_embedded(app_t *app)
+{
+	zip_error_t error;
+	zip_source_t *src;
+	struct zip *io;
+
+	zip_error_init(&error);
+	if(!(src = zip_source_buffer_create(app_zip, app_zip_size, 0, &error)))
+	{
+		fprintf(stderr, "zip_source_buffer_create: %s\n", zip_error_strerror(&error));
+		zip_error_fini(&error);
+		return NULL;
+	}
+
+	if(!(io = zip_open_from_source(src, ZIP_RDONLY, &error)))
+	{
+		fprintf(stderr, "zip_open_from_source: %s\n", zip_error_strerror(&error));
+		zip_source_free(src);
+	}
+	else
+	{
+		app->embed = app_zip;
+		app->nembed = app_zip_size;
+	}
+	zip_error_fini(&error);
+
+	return io;
+}
+#endif
 
 static void
 _deinit(app_t *app)
 {
+	// in-flight static reads must not call back into the closed state
+	zip_cancel_async(app);
 	lua_close(app->L);
 
 	uv_signal_stop(&app->sigint);
@@ -61,6 +104,112 @@ _sig(uv_signal_t *handle, int signum)
 	_deinit(app);
 }
 
+static void
+_mkdir(uv_loop_t *loop, const char *path)
+{
+	uv_fs_t req;
+
+	uv_fs_mkdir(loop, &req, path, 0755, NULL);
+	uv_fs_req_cleanup(&req);
+}
+
+// resolve and create per-user cache directory for module bytecode
+static void
+_bytecode_dir_init(app_t *app)
+{
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+#if defined(__WINDOWS__)
+	const char *local = getenv("LOCALAPPDATA");
+#endif
+	char base [PATH_LEN];
+
+	if(xdg && xdg[0])
+		snprintf(base, PATH_LEN, "%s", xdg);
+#if defined(__WINDOWS__)
+	else if(local && local[0])
+		snprintf(base, PATH_LEN, "%s", local);
+#endif
+	else if(home && home[0])
+	{
+		snprintf(base, PATH_LEN, "%s/.cache", home);
+		_mkdir(app->loop, base);
+	}
+	else
+		return;
+
+	if(snprintf(bytecode_dir, PATH_LEN, "%s/chimaerad", base) >= PATH_LEN)
+	{
+		bytecode_dir[0] = '\0';
+		return;
+	}
+	_mkdir(app->loop, bytecode_dir);
+}
+
+static int
+_bytecode_write(lua_State *L, const void *p, size_t sz, void *ud)
+{
+	FILE *f = ud;
+
+	return fwrite(p, 1, sz, f) != sz;
+}
+
+// load module from bytecode file keyed by crc of its source
+static int
+_bytecode_load(lua_State *L, const char *path, const char *module)
+{
+	FILE *f = fopen(path, "rb");
+	if(!f)
+		return -1;
+
+	int err = -1;
+	if(!fseek(f, 0, SEEK_END))
+	{
+		const long size = ftell(f);
+		char *chunk = size > 0 ? malloc(size) : NULL;
+
+		if(chunk)
+		{
+			rewind(f);
+			if(fread(chunk, 1, size, f) == (size_t)size)
+			{
+				// rejects source and bytecode of foreign Lua versions
+				if((err = luaL_loadbufferx(L, chunk, size, module, "b")))
+					lua_pop(L, 1);
+			}
+			free(chunk);
+		}
+	}
+	fclose(f);
+
+	return err;
+}
+
+// dump freshly loaded module at stack top, replace file atomically
+static void
+_bytecode_store(lua_State *L, const char *path)
+{
+	char tmp [PATH_LEN + 8];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	FILE *f = fopen(tmp, "wb");
+	if(!f)
+		return;
+
+	const int err = lua_dump(L, _bytecode_write, f, 0);
+	if(fclose(f) || err)
+	{
+		remove(tmp);
+		return;
+	}
+
+#if defined(__WINDOWS__)
+	remove(path); // rename does not overwrite on windows
+#endif
+	if(rename(tmp, path))
+		remove(tmp);
+}
+
 static int
 _zip_loader(lua_State *L)
 {
@@ -68,14 +217,24 @@ _zip_loader(lua_State *L)
 	const char *module = luaL_checkstring(L, 1);
 
 	char key [256];
-	sprintf(key, "%s.lua", module);
+	snprintf(key, sizeof(key), "%s.lua", module);
+
+	// bytecode is keyed by crc of source, stale files are never picked up
+	char path [PATH_LEN];
+	const zip_info_t *info = zip_info(app, key);
+	const int cacheable = bytecode_dir[0] && info
+		&& (snprintf(path, PATH_LEN, "%s/%s-%08"PRIx32".luac", bytecode_dir, module, info->crc) < PATH_LEN);
+
+	if(cacheable && !_bytecode_load(L, path, module))
+		return 1;
 
 	size_t size;
-	uint8_t *chunk = zip_read(app, key, &size);
+	const uint8_t *chunk = zip_acquire(app, key, &size, 0);
 	if(chunk)
 	{
-		luaL_loadbuffer(L, (char *)chunk, size, module);
-		free(chunk);
+		if(!luaL_loadbuffer(L, (const char *)chunk, size, module) && cacheable)
+			_bytecode_store(L, path);
+		zip_release(app, chunk);
 	}
 	else
 		lua_pushstring(L, "module not found");
@@ -98,15 +257,32 @@ main(int argc, char **argv)
 
 	luaL_openlibs(app.L);
 	luaopen_json(&app);
+	luaopen_cbor(&app);
 	luaopen_osc(&app);
 	luaopen_http(&app);
 	luaopen_zip(&app);
 	luaopen_iface(&app);
 	luaopen_dns_sd(&app);
 
-	app.io = zip_open(argv[1], ZIP_CHECKCONS, &err);
+	// explicit bundle path overrides embedded one
+	if(argc > 1)
+	{
+		app.bundle = argv[1];
+		app.io = zip_open(app.bundle, ZIP_CHECKCONS, &err);
+		if(!app.io)
+		{
+			fprintf(stderr, "zip_open: %s: %i\n", app.bundle, err);
+			app.bundle = NULL;
+		}
+	}
+#if defined(EMBED_BUNDLE)
+	if(!app.io)
+		app.io = _zip_open_embedded(&app);
+#endif
 	if(!app.io)
-		fprintf(stderr, "zip_open: %i\n", err);
+		fprintf(stderr, "no app bundle available\n");
+
+	_bytecode_dir_init(&app);
 	
 	lua_getglobal(app.L, "package");
 	if(lua_istable(app.L, -1))
@@ -149,6 +325,7 @@ main(int argc, char **argv)
 
 	uv_run(app.loop, UV_RUN_DEFAULT);
 
+	zip_cache_free(&app);
 	if(app.io)
 		zip_close(app.io);
 	
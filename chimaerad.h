@@ -38,11 +38,18 @@ extern "C" {
 #include <lua.h>
 
 typedef struct _app_t app_t;
+typedef struct _zip_cache_t zip_cache_t;
+typedef struct _zip_info_t zip_info_t;
+typedef void (*zip_cb_t)(app_t *app, const uint8_t *chunk, size_t size, void *data);
 
 struct _app_t {
 	uv_loop_t *loop;
 	lua_State *L;
+	const char *bundle; // path of archive file
+	const uint8_t *embed; // archive linked into executable
+	size_t nembed;
 	struct zip *io;
+	zip_cache_t *cache;
 
 	uv_signal_t sigint;
 	uv_signal_t sigterm;
@@ -51,9 +58,27 @@ struct _app_t {
 #endif
 };
 
-uint8_t *zip_read(app_t *app, const char *key, size_t *size);
+struct _zip_info_t {
+	const char *name;
+	zip_uint64_t index;
+	zip_uint64_t size;
+	zip_uint64_t comp_size;
+	uint32_t crc;
+	uint16_t comp_method;
+	int deflated; // deflate without encryption, can be passed through as gzip
+	const char *mime;
+	const uint8_t *mapped; // data of stored entry in mapping of archive file or NULL
+};
+
+const uint8_t *zip_acquire(app_t *app, const char *key, size_t *size, int gzip);
+void zip_release(app_t *app, const uint8_t *data);
+void zip_acquire_async(app_t *app, const char *key, int gzip, zip_cb_t cb, void *data);
+void zip_cancel_async(app_t *app);
+void zip_cache_free(app_t *app);
+const zip_info_t *zip_info(app_t *app, const char *key);
 
 int luaopen_json(app_t *app);
+int luaopen_cbor(app_t *app);
 int luaopen_osc(app_t *app);
 int luaopen_http(app_t *app);
 int luaopen_zip(app_t *app);
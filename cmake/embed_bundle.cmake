@@ -0,0 +1,15 @@
+# convert INPUT into C source OUTPUT defining app_zip and app_zip_size,
+# invoked at build time via cmake -P
+file(READ ${INPUT} HEX HEX)
+string(LENGTH "${HEX}" HEX_LEN)
+math(EXPR SIZE "${HEX_LEN} / 2")
+
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," BYTES "${HEX}")
+string(REGEX REPLACE "((0x[0-9a-f][0-9a-f],)(0x[0-9a-f][0-9a-f],)(0x[0-9a-f][0-9a-f],)(0x[0-9a-f][0-9a-f],)(0x[0-9a-f][0-9a-f],)(0x[0-9a-f][0-9a-f],)(0x[0-9a-f][0-9a-f],)(0x[0-9a-f][0-9a-f],))" "\\1\n\t" BYTES "${BYTES}")
+
+file(WRITE ${OUTPUT}
+	"// generated from app.zip, do not edit\n\n"
+	"#include <stddef.h>\n"
+	"#include <stdint.h>\n\n"
+	"const uint8_t app_zip [] __attribute__((aligned(16))) = {\n\t${BYTES}\n};\n\n"
+	"const size_t app_zip_size = ${SIZE};\n")
@@ -0,0 +1,684 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <chimaerad.h>
+#include <mod_enc_common.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#if(LUA_VERSION_NUM >= 502)
+#	define lua_objlen lua_rawlen
+#endif
+
+#define DEPTH_MAX 64 // max nesting of tables
+
+// RFC 7049 major types
+enum {
+	MAJOR_UINT = 0,
+	MAJOR_NINT = 1,
+	MAJOR_BYTES = 2,
+	MAJOR_TEXT = 3,
+	MAJOR_ARRAY = 4,
+	MAJOR_MAP = 5,
+	MAJOR_TAG = 6,
+	MAJOR_SIMPLE = 7
+};
+
+// RFC 8746 typed array tags
+enum {
+	TAG_ARRAY_MIN = 64,
+	TAG_SINT16_LE = 77,
+	TAG_FLOAT32_LE = 85,
+	TAG_ARRAY_MAX = 87
+};
+
+typedef struct _dec_t dec_t;
+typedef struct _cbor_array_t cbor_array_t;
+
+// parser state over length-delimited input
+struct _dec_t {
+	const uint8_t *buf;
+	const uint8_t *ptr;
+	const uint8_t *end;
+	unsigned depth;
+	const char *err;
+};
+
+// numeric array packed little-endian, encoded as typed array
+struct _cbor_array_t {
+	uint64_t tag;
+	size_t size;
+	uint8_t data [];
+};
+
+// initial byte with shortest argument encoding
+static int
+_enc_head(enc_t *enc, uint8_t major, uint64_t val)
+{
+	uint8_t head [9];
+	size_t len;
+
+	if(val < 24)
+	{
+		head[0] = (major << 5) | val;
+		len = 1;
+	}
+	else if(val <= UINT8_MAX)
+	{
+		head[0] = (major << 5) | 24;
+		len = 2;
+	}
+	else if(val <= UINT16_MAX)
+	{
+		head[0] = (major << 5) | 25;
+		len = 3;
+	}
+	else if(val <= UINT32_MAX)
+	{
+		head[0] = (major << 5) | 26;
+		len = 5;
+	}
+	else
+	{
+		head[0] = (major << 5) | 27;
+		len = 9;
+	}
+
+	for(size_t i=1; i<len; i++) // big-endian argument
+		head[i] = val >> ((len - 1 - i)*8);
+
+	return mod_enc_put(enc, head, len);
+}
+
+static int
+_enc_number(enc_t *enc, lua_State *L, int idx)
+{
+	if(lua_isinteger(L, idx))
+	{
+		const lua_Integer i = lua_tointeger(L, idx);
+
+		return i >= 0
+			? _enc_head(enc, MAJOR_UINT, i)
+			: _enc_head(enc, MAJOR_NINT, -(uint64_t)(i + 1));
+	}
+
+	const double d = lua_tonumber(L, idx);
+	const float f = d;
+	uint8_t buf [9];
+
+	if(isnan(d))
+	{
+		static const uint8_t nan [3] = {0xf9, 0x7e, 0x00}; // canonical half NaN
+		return mod_enc_put(enc, nan, sizeof(nan));
+	}
+
+	if( (double)f == d) // lossless as single precision
+	{
+		uint32_t u;
+		memcpy(&u, &f, 4);
+		buf[0] = 0xfa;
+		for(unsigned i=0; i<4; i++)
+			buf[1 + i] = u >> ((3 - i)*8);
+		return mod_enc_put(enc, buf, 5);
+	}
+
+	uint64_t u;
+	memcpy(&u, &d, 8);
+	buf[0] = 0xfb;
+	for(unsigned i=0; i<8; i++)
+		buf[1 + i] = u >> ((7 - i)*8);
+	return mod_enc_put(enc, buf, 9);
+}
+
+static int
+_enc_string(enc_t *enc, lua_State *L, int idx)
+{
+	size_t len;
+	const char *str = lua_tolstring(L, idx, &len);
+
+	if(_enc_head(enc, MAJOR_TEXT, len))
+		return -1;
+
+	return mod_enc_put(enc, str, len);
+}
+
+// forward declaration
+static int _encode_item(enc_t *enc, lua_State *L, int idx);
+
+static int
+_encode_array(enc_t *enc, lua_State *L, int idx, size_t n)
+{
+	if(mod_enc_enter(enc, L, idx) || _enc_head(enc, MAJOR_ARRAY, n))
+		return -1;
+
+	for(size_t i=1; i<=n; i++)
+	{
+		lua_rawgeti(L, idx, i);
+		if(!mod_enc_encodable(L, -1, "cbor_array_t"))
+		{
+			fprintf(stderr, "cannot encode %s at %zu\n", luaL_typename(L, -1), i);
+			lua_pop(L, 1);
+			lua_pushnil(L); // keep array positions
+		}
+		if(_encode_item(enc, L, lua_gettop(L)))
+			return -1;
+		lua_pop(L, 1);
+	}
+
+	mod_enc_leave(enc);
+	return 0;
+}
+
+static int
+_encode_map(enc_t *enc, lua_State *L, int idx)
+{
+	size_t n = 0;
+
+	if(mod_enc_enter(enc, L, idx))
+		return -1;
+
+	// count encodable pairs first, maps are encoded with definite length
+	lua_pushnil(L);
+	while(lua_next(L, idx))
+	{
+		if(mod_enc_encodable(L, -1, "cbor_array_t"))
+			n++;
+		lua_pop(L, 1);
+	}
+
+	if(_enc_head(enc, MAJOR_MAP, n))
+		return -1;
+
+	lua_pushnil(L);
+	while(lua_next(L, idx))
+	{
+		const int key = lua_gettop(L) - 1;
+		const int val = key + 1;
+
+		if(!mod_enc_encodable(L, val, "cbor_array_t"))
+		{
+			fprintf(stderr, "cannot encode %s at %s\n", luaL_typename(L, val),
+				lua_type(L, key) == LUA_TSTRING ? lua_tostring(L, key) : "?");
+			lua_pop(L, 1);
+			continue;
+		}
+
+		// number keys stay numbers, no in-place conversion needed
+		if( ( (lua_type(L, key) != LUA_TSTRING) && (lua_type(L, key) != LUA_TNUMBER) )
+			|| _encode_item(enc, L, key) || _encode_item(enc, L, val) )
+		{
+			if(!enc->err)
+				enc->err = "invalid map key";
+			return -1;
+		}
+
+		lua_pop(L, 1);
+	}
+
+	mod_enc_leave(enc);
+	return 0;
+}
+
+static int
+_encode_item(enc_t *enc, lua_State *L, int idx)
+{
+	static const uint8_t f = 0xf4;
+	static const uint8_t t = 0xf5;
+	static const uint8_t null = 0xf6;
+	cbor_array_t *arr;
+	size_t len;
+
+	switch(lua_type(L, idx))
+	{
+		case LUA_TNIL:
+			return mod_enc_put(enc, &null, 1);
+		case LUA_TBOOLEAN:
+			return mod_enc_put(enc, lua_toboolean(L, idx) ? &t : &f, 1);
+		case LUA_TNUMBER:
+			return _enc_number(enc, L, idx);
+		case LUA_TSTRING:
+			return _enc_string(enc, L, idx);
+		case LUA_TTABLE:
+			len = lua_objlen(L, idx);
+			if(!len)
+				return _encode_map(enc, L, idx);
+			else
+				return _encode_array(enc, L, idx, len);
+		case LUA_TUSERDATA:
+			if((arr = luaL_testudata(L, idx, "cbor_array_t")))
+			{
+				if(_enc_head(enc, MAJOR_TAG, arr->tag) || _enc_head(enc, MAJOR_BYTES, arr->size))
+					return -1;
+				return mod_enc_put(enc, arr->data, arr->size);
+			}
+			// fall-through
+		default:
+			enc->err = "cannot encode value";
+			return -1;
+	}
+}
+
+// Lua -> CBOR
+static int
+_encode(lua_State *L)
+{
+	//app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+	enc_t *enc = lua_touserdata(L, lua_upvalueindex(2));
+
+	lua_settop(L, 1);
+
+	mod_enc_reset(enc);
+
+	if(!mod_enc_encodable(L, 1, "cbor_array_t") || _encode_item(enc, L, 1))
+	{
+		lua_pushstring(L, enc->err ? enc->err : "cannot encode value");
+		lua_pushnil(L);
+	}
+	else
+	{
+		lua_pushnil(L); // no error
+		lua_pushlstring(L, enc->buf, enc->len);
+	}
+
+	mod_enc_finish(enc);
+
+	return 2;
+}
+
+static inline int
+_dec_fail(dec_t *dec, const char *err)
+{
+	dec->err = err;
+	return -1;
+}
+
+static uint64_t
+_dec_uint(const uint8_t *ptr, size_t len, int le)
+{
+	uint64_t val = 0;
+
+	for(size_t i=0; i<len; i++)
+		val = (val << 8) | ptr[le ? len - 1 - i : i];
+
+	return val;
+}
+
+static double
+_dec_half(uint16_t h)
+{
+	const int exp = (h >> 10) & 0x1f;
+	const int mant = h & 0x3ff;
+	double val;
+
+	if(exp == 0)
+		val = ldexp(mant, -24);
+	else if(exp != 31)
+		val = ldexp(mant + 1024, exp - 25);
+	else
+		val = mant == 0 ? INFINITY : NAN;
+
+	return h & 0x8000 ? -val : val;
+}
+
+// interpret bits of half, single or double precision float
+static double
+_dec_float(uint64_t u, size_t len)
+{
+	if(len == 2)
+		return _dec_half(u);
+	else if(len == 4)
+	{
+		const uint32_t u32 = u;
+		float f;
+		memcpy(&f, &u32, 4);
+		return f;
+	}
+
+	double d;
+	memcpy(&d, &u, 8);
+	return d;
+}
+
+static int
+_dec_head(dec_t *dec, uint8_t *major, uint8_t *info, uint64_t *val)
+{
+	if(dec->ptr == dec->end)
+		return _dec_fail(dec, "unexpected end of input");
+
+	*major = *dec->ptr >> 5;
+	*info = *dec->ptr & 0x1f;
+	dec->ptr++;
+
+	if(*info < 24)
+	{
+		*val = *info;
+		return 0;
+	}
+
+	if(*info > 27)
+		return _dec_fail(dec, *info == 31 ? "indefinite length unsupported" : "invalid initial byte");
+
+	const size_t len = 1 << (*info - 24);
+	if((size_t)(dec->end - dec->ptr) < len)
+		return _dec_fail(dec, "unexpected end of input");
+
+	*val = _dec_uint(dec->ptr, len, 0);
+	dec->ptr += len;
+	return 0;
+}
+
+// unpack RFC 8746 typed array into plain Lua array
+static int
+_dec_typed_array(dec_t *dec, lua_State *L, uint64_t tag, const uint8_t *data, size_t size)
+{
+	const int is_float = (tag >> 4) & 1;
+	const int is_signed = (tag >> 3) & 1;
+	const int le = (tag >> 2) & 1;
+	const unsigned ll = tag & 3;
+	const size_t width = is_float ? 2u << ll : 1u << ll;
+
+	if( (is_float && (is_signed || (ll == 3))) // no signed floats, no float128
+		|| (tag == 76) ) // reserved
+		return _dec_fail(dec, "unsupported typed array");
+
+	if(size % width)
+		return _dec_fail(dec, "invalid typed array length");
+
+	const size_t n = size / width;
+	lua_createtable(L, n, 0);
+
+	for(size_t i=0; i<n; i++)
+	{
+		const uint8_t *ptr = data + i*width;
+
+		if(is_float)
+			lua_pushnumber(L, _dec_float(_dec_uint(ptr, width, le), width));
+		else
+		{
+			uint64_t u = _dec_uint(ptr, width, le);
+
+			if(is_signed && (width < 8) && (u >> (width*8 - 1)))
+				u |= ~0ULL << (width*8); // sign extend
+			if(!is_signed && (u > LUA_MAXINTEGER))
+				lua_pushnumber(L, u);
+			else
+				lua_pushinteger(L, (lua_Integer)u);
+		}
+		lua_rawseti(L, -2, i + 1);
+	}
+
+	return 0;
+}
+
+static int
+_dec_item(dec_t *dec, lua_State *L)
+{
+	uint8_t major;
+	uint8_t info;
+	uint64_t val;
+
+	if(_dec_head(dec, &major, &info, &val))
+		return -1;
+
+	const size_t avail = dec->end - dec->ptr;
+
+	switch(major)
+	{
+		case MAJOR_UINT:
+			if(val <= LUA_MAXINTEGER)
+				lua_pushinteger(L, val);
+			else
+				lua_pushnumber(L, val);
+			return 0;
+
+		case MAJOR_NINT:
+			if(val <= LUA_MAXINTEGER)
+				lua_pushinteger(L, -1 - (lua_Integer)val);
+			else
+				lua_pushnumber(L, -1.0 - (double)val);
+			return 0;
+
+		case MAJOR_BYTES:
+		case MAJOR_TEXT:
+			if(val > avail)
+				return _dec_fail(dec, "unexpected end of input");
+			lua_pushlstring(L, (const char *)dec->ptr, val);
+			dec->ptr += val;
+			return 0;
+
+		case MAJOR_ARRAY:
+		case MAJOR_MAP:
+		{
+			// each item takes at least one byte, bounds presizing by input
+			if(val > avail)
+				return _dec_fail(dec, "unexpected end of input");
+
+			if(++dec->depth > DEPTH_MAX)
+				return _dec_fail(dec, "nesting too deep");
+			if(!lua_checkstack(L, 4))
+				return _dec_fail(dec, "stack overflow");
+
+			if(major == MAJOR_ARRAY)
+			{
+				lua_createtable(L, val, 0);
+				for(uint64_t i=0; i<val; i++)
+				{
+					if(_dec_item(dec, L))
+						return -1;
+					lua_rawseti(L, -2, i + 1);
+				}
+			}
+			else
+			{
+				lua_createtable(L, 0, val);
+				for(uint64_t i=0; i<val; i++)
+				{
+					if(_dec_item(dec, L) || _dec_item(dec, L))
+						return -1;
+					if(lua_isnil(L, -2) || (lua_isnumber(L, -2) && isnan(lua_tonumber(L, -2))))
+						return _dec_fail(dec, "invalid map key");
+					lua_rawset(L, -3); // null values leave keys absent
+				}
+			}
+
+			dec->depth--;
+			return 0;
+		}
+
+		case MAJOR_TAG:
+			if( (val >= TAG_ARRAY_MIN) && (val <= TAG_ARRAY_MAX)
+				&& (dec->ptr < dec->end) && ((*dec->ptr >> 5) == MAJOR_BYTES) )
+			{
+				uint64_t size;
+				if(_dec_head(dec, &major, &info, &size))
+					return -1;
+				if(size > (uint64_t)(dec->end - dec->ptr))
+					return _dec_fail(dec, "unexpected end of input");
+
+				const uint8_t *data = dec->ptr;
+				dec->ptr += size;
+				return _dec_typed_array(dec, L, val, data, size);
+			}
+
+			// other tags are ignored, their content is decoded as is
+			return _dec_item(dec, L);
+
+		case MAJOR_SIMPLE:
+			switch(info)
+			{
+				case 20:
+					lua_pushboolean(L, 0);
+					return 0;
+				case 21:
+					lua_pushboolean(L, 1);
+					return 0;
+				case 22: // null
+				case 23: // undefined
+					lua_pushnil(L);
+					return 0;
+				case 25:
+				case 26:
+				case 27:
+					lua_pushnumber(L, _dec_float(val, 1 << (info - 24)));
+					return 0;
+				default:
+					return _dec_fail(dec, "unsupported simple value");
+			}
+	}
+
+	return _dec_fail(dec, "invalid initial byte");
+}
+
+// CBOR -> Lua, decodes byte range i..j of string, returns offset on error
+static int
+_decode(lua_State *L)
+{
+	size_t len;
+	const char *str = luaL_checklstring(L, 1, &len);
+	lua_Integer i = luaL_optinteger(L, 2, 1);
+	lua_Integer j = luaL_optinteger(L, 3, len);
+
+	if(i < 1)
+		i = 1;
+	if(j > (lua_Integer)len)
+		j = len;
+
+	const uint8_t *buf = (const uint8_t *)str;
+	dec_t dec = {
+		.buf = buf,
+		.ptr = buf + i - 1,
+		.end = i <= j ? buf + j : buf + i - 1,
+		.depth = 0,
+		.err = NULL
+	};
+
+	lua_settop(L, 3);
+
+	if(!_dec_item(&dec, L))
+	{
+		if(dec.ptr == dec.end)
+		{
+			lua_pushnil(L); // no error
+			lua_insert(L, -2);
+			return 2;
+		}
+
+		dec.err = "trailing bytes";
+	}
+
+	lua_settop(L, 3);
+	lua_pushfstring(L, "%s at offset %d", dec.err, (int)(dec.ptr - dec.buf));
+	lua_pushnil(L);
+	lua_pushinteger(L, dec.ptr - dec.buf);
+
+	return 3;
+}
+
+// pack array of numbers into typed array of given tag and element width
+static int
+_pack(lua_State *L, uint64_t tag, size_t width)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	const size_t n = lua_objlen(L, 1);
+
+	cbor_array_t *arr = lua_newuserdata(L, sizeof(cbor_array_t) + n*width);
+	arr->tag = tag;
+	arr->size = n*width;
+
+	for(size_t i=0; i<n; i++)
+	{
+		uint8_t *dst = arr->data + i*width;
+		uint32_t u;
+
+		lua_rawgeti(L, 1, i + 1);
+		if(tag == TAG_FLOAT32_LE)
+		{
+			const float f = luaL_checknumber(L, -1);
+			memcpy(&u, &f, 4);
+		}
+		else
+		{
+			const lua_Integer v = luaL_checkinteger(L, -1);
+			luaL_argcheck(L, (v >= INT16_MIN) && (v <= INT16_MAX), 1, "value out of int16 range");
+			u = (uint16_t)v;
+		}
+		lua_pop(L, 1);
+
+		for(size_t b=0; b<width; b++) // little-endian
+			dst[b] = u >> (b*8);
+	}
+
+	luaL_getmetatable(L, "cbor_array_t");
+	lua_setmetatable(L, -2);
+
+	return 1;
+}
+
+static int
+_int16(lua_State *L)
+{
+	return _pack(L, TAG_SINT16_LE, 2);
+}
+
+static int
+_float32(lua_State *L)
+{
+	return _pack(L, TAG_FLOAT32_LE, 4);
+}
+
+static int
+_array_len(lua_State *L)
+{
+	cbor_array_t *arr = luaL_checkudata(L, 1, "cbor_array_t");
+
+	lua_pushinteger(L, arr->size / (arr->tag == TAG_FLOAT32_LE ? 4 : 2));
+
+	return 1;
+}
+
+static const luaL_Reg lcbor [] = {
+	{"encode", _encode},
+	{"decode", _decode},
+	{"int16", _int16},
+	{"float32", _float32},
+	{NULL, NULL}
+};
+
+int
+luaopen_cbor(app_t *app)
+{
+	lua_State *L = app->L;
+
+	luaL_newmetatable(L, "cbor_array_t");
+	lua_pushcfunction(L, _array_len);
+	lua_setfield(L, -2, "__len");
+	lua_pop(L, 1);
+
+	lua_newtable(L);
+	lua_pushlightuserdata(L, app);
+	mod_enc_new(L);
+	luaL_setfuncs(L, lcbor, 2);
+	lua_setglobal(L, "CBOR");
+
+	return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#include <stdlib.h>
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include <mod_enc_common.h>
+
+#define ENC_MIN 0x1000 // initial size of encoder buffer
+#define ENC_KEEP 0x100000 // max size of encoder buffer kept across calls
+
+static int
+_enc_gc(lua_State *L)
+{
+	enc_t *enc = lua_touserdata(L, 1);
+
+	free(enc->buf);
+	enc->buf = NULL;
+	enc->size = 0;
+
+	return 0;
+}
+
+// push new encoder userdata which frees its buffer on collection
+enc_t *
+mod_enc_new(lua_State *L)
+{
+	enc_t *enc = lua_newuserdata(L, sizeof(enc_t));
+	memset(enc, 0, sizeof(enc_t));
+
+	lua_createtable(L, 0, 1);
+	lua_pushcfunction(L, _enc_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+
+	return enc;
+}
+
+void
+mod_enc_reset(enc_t *enc)
+{
+	enc->len = 0;
+	enc->depth = 0;
+	enc->err = NULL;
+}
+
+// don't hold on to buffers of exceptionally large documents
+void
+mod_enc_finish(enc_t *enc)
+{
+	if(enc->size > ENC_KEEP)
+	{
+		free(enc->buf);
+		enc->buf = NULL;
+		enc->size = 0;
+	}
+}
+
+int
+mod_enc_grow(enc_t *enc, size_t n)
+{
+	if(enc->len + n <= enc->size)
+		return 0;
+
+	size_t size = enc->size ? enc->size : ENC_MIN;
+	while(size < enc->len + n)
+		size <<= 1;
+
+	char *buf = realloc(enc->buf, size);
+	if(!buf)
+	{
+		enc->err = "out of memory";
+		return -1;
+	}
+
+	enc->buf = buf;
+	enc->size = size;
+	return 0;
+}
+
+// guard nesting depth and cycles before descending into table at idx
+int
+mod_enc_enter(enc_t *enc, lua_State *L, int idx)
+{
+	const void *tab = lua_topointer(L, idx);
+
+	if(enc->depth >= ENC_DEPTH_MAX)
+	{
+		enc->err = "nesting too deep";
+		return -1;
+	}
+
+	for(unsigned i=0; i<enc->depth; i++)
+	{
+		if(enc->stack[i] == tab)
+		{
+			enc->err = "cycle detected";
+			return -1;
+		}
+	}
+
+	if(!lua_checkstack(L, 3))
+	{
+		enc->err = "stack overflow";
+		return -1;
+	}
+
+	enc->stack[enc->depth++] = tab;
+	return 0;
+}
+
+// plain Lua values or userdata with given metatable name, if any
+int
+mod_enc_encodable(lua_State *L, int idx, const char *udata)
+{
+	switch(lua_type(L, idx))
+	{
+		case LUA_TNIL:
+		case LUA_TBOOLEAN:
+		case LUA_TNUMBER:
+		case LUA_TSTRING:
+		case LUA_TTABLE:
+			return 1;
+		case LUA_TUSERDATA:
+			return udata && luaL_testudata(L, idx, udata);
+		default:
+			return 0;
+	}
+}
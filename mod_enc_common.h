@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2015 Hanspeter Portner (dev@open-music-kontrollers.ch)
+ *
+ * This is free software: you can redistribute it and/or modify
+ * it under the terms of the Artistic License 2.0 as published by
+ * The Perl Foundation.
+ *
+ * This source is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Artistic License 2.0 for more details.
+ *
+ * You should have received a copy of the Artistic License 2.0
+ * along the source as a COPYING file. If not, obtain it from
+ * http://www.perlfoundation.org/artistic_license_2_0.
+ */
+
+#ifndef _CHIMAERAD_MOD_ENC_COMMON_H
+#define _CHIMAERAD_MOD_ENC_COMMON_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include <lua.h>
+
+#define ENC_DEPTH_MAX 64 // max nesting of tables
+
+typedef struct _enc_t enc_t;
+
+// reusable output buffer of JSON and CBOR encoders, lives as upvalue of encode
+struct _enc_t {
+	char *buf;
+	size_t len;
+	size_t size;
+
+	// tables currently being encoded, for cycle detection
+	const void *stack [ENC_DEPTH_MAX];
+	unsigned depth;
+
+	const char *err;
+};
+
+enc_t *mod_enc_new(lua_State *L);
+void mod_enc_reset(enc_t *enc);
+void mod_enc_finish(enc_t *enc);
+int mod_enc_grow(enc_t *enc, size_t n);
+int mod_enc_enter(enc_t *enc, lua_State *L, int idx);
+int mod_enc_encodable(lua_State *L, int idx, const char *udata);
+
+static inline int
+mod_enc_put(enc_t *enc, const void *data, size_t len)
+{
+	if(mod_enc_grow(enc, len))
+		return -1;
+
+	memcpy(enc->buf + enc->len, data, len);
+	enc->len += len;
+	return 0;
+}
+
+static inline void
+mod_enc_leave(enc_t *enc)
+{
+	enc->depth--;
+}
+
+#endif
@@ -17,6 +17,9 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <inttypes.h>
 
 #include <chimaerad.h>
 
@@ -29,12 +32,179 @@
 
 #include <http_parser.h>
 
+#define IDLE_TIMEOUT 15 // s
+#define IDLE_INTERVAL 1000 // ms
+#define BACKLOG_MAX 0x10000 // max size of pipelined requests in flight
+#define POOL_BUF_SIZE 0x10000 // size of pooled receive buffers
+#define POOL_MAX 8 // max number of pooled receive buffers
+#define PARTS_MAX 8 // max number of parts per response
+#define ARENA_SIZE 0x2000 // max size of url and headers per request
+#define HEADER_MAX 48 // max number of headers per request
+#define BODY_MAX 0x100000 // default max size of buffered request bodies
+#define EVENT_BACKLOG_MAX 0x40000 // max size of unsent events per client
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_HEADER_MAX 14 // max size of masked frame header
+#define API_PREFIX "/api/" // default prefix of urls dispatched to Lua
+#define KEY_MAX 256 // max length of zip entry names
+#define MAX_AGE 0 // default Cache-Control max-age of non-html assets in s
+
+typedef enum _client_state_t client_state_t;
+typedef enum _header_id_t header_id_t;
+typedef enum _parse_state_t parse_state_t;
+typedef enum _ws_opcode_t ws_opcode_t;
+typedef struct _span_t span_t;
+typedef struct _header_t header_t;
+typedef struct _request_t request_t;
+typedef struct _chunk_t chunk_t;
+typedef struct _write_t write_t;
+typedef struct _shared_t shared_t;
+typedef struct _pool_t pool_t;
 typedef struct _server_t server_t;
 typedef struct _client_t client_t;
 
+enum _client_state_t {
+	CLIENT_IDLE = 0,	// waiting for next request
+	CLIENT_BUSY,			// request dispatched to Lua, waiting for response
+	CLIENT_WRITING,		// response in flight
+	CLIENT_EVENTS,		// streaming server-sent events
+	CLIENT_WEBSOCKET,	// upgraded to websocket
+	CLIENT_CLOSING		// websocket close handshake in progress
+};
+
+// interned header names, used for lookups from C
+enum _header_id_t {
+	HEADER_UNKNOWN = 0,
+	HEADER_HOST,
+	HEADER_CONNECTION,
+	HEADER_CONTENT_TYPE,
+	HEADER_CONTENT_LENGTH,
+	HEADER_ACCEPT,
+	HEADER_ACCEPT_ENCODING,
+	HEADER_IF_NONE_MATCH,
+	HEADER_UPGRADE,
+	HEADER_SEC_WEBSOCKET_KEY,
+	HEADER_SEC_WEBSOCKET_VERSION,
+
+	HEADER_ID_MAX
+};
+
+static const char http_304 [] =
+	"HTTP/1.1 304 Not Modified\r\n";
+
+static const char http_404 [] =
+	"HTTP/1.1 404 Not Found\r\n"
+	"Content-Length: 0\r\n\r\n";
+
+static const char http_413 [] =
+	"HTTP/1.1 413 Payload Too Large\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n\r\n";
+
+static const char http_500 [] =
+	"HTTP/1.1 500 Internal Server Error\r\n"
+	"Content-Length: 0\r\n"
+	"Connection: close\r\n\r\n";
+
+static const char http_events [] =
+	"HTTP/1.1 200 OK\r\n"
+	"Content-Type: text/event-stream\r\n"
+	"Cache-Control: no-cache\r\n\r\n";
+
+static const char event_ping [] = ":\n\n";
+
+static const char *header_names [HEADER_ID_MAX] = {
+	[HEADER_UNKNOWN] = NULL,
+	[HEADER_HOST] = "host",
+	[HEADER_CONNECTION] = "connection",
+	[HEADER_CONTENT_TYPE] = "content-type",
+	[HEADER_CONTENT_LENGTH] = "content-length",
+	[HEADER_ACCEPT] = "accept",
+	[HEADER_ACCEPT_ENCODING] = "accept-encoding",
+	[HEADER_IF_NONE_MATCH] = "if-none-match",
+	[HEADER_UPGRADE] = "upgrade",
+	[HEADER_SEC_WEBSOCKET_KEY] = "sec-websocket-key",
+	[HEADER_SEC_WEBSOCKET_VERSION] = "sec-websocket-version"
+};
+
+enum _ws_opcode_t {
+	WS_CONTINUATION	= 0x0,
+	WS_TEXT					= 0x1,
+	WS_BINARY				= 0x2,
+	WS_CLOSE				= 0x8,
+	WS_PING					= 0x9,
+	WS_PONG					= 0xa
+};
+
+enum _parse_state_t {
+	PARSE_NONE = 0,
+	PARSE_FIELD,
+	PARSE_VALUE
+};
+
+struct _span_t {
+	uint16_t offset;
+	uint16_t len;
+};
+
+struct _header_t {
+	header_id_t id;
+	span_t name;
+	span_t value;
+};
+
+// per-request arena, http_parser may deliver fragments across reads
+struct _request_t {
+	char arena [ARENA_SIZE];
+	size_t narena;
+
+	span_t url;
+	header_t headers [HEADER_MAX];
+	unsigned nheaders;
+	parse_state_t state;
+	int native; // served from app bundle without Lua
+};
+
+// view on a body chunk, only valid for the duration of a sink call
+struct _chunk_t {
+	const char *at;
+	size_t len;
+};
+
+// detached write, e.g. for server-sent events
+struct _write_t {
+	uv_write_t req;
+	int refs [2]; // pinned Lua strings
+	char *data; // or copied data
+	uint8_t hdr [10]; // websocket frame header
+	int close; // close connection once written
+};
+
+// response written identically to many clients, freed with its last write
+struct _shared_t {
+	int refs;
+	size_t len;
+	char data [];
+};
+
+struct _pool_t {
+	char *bufs [POOL_MAX];
+	unsigned nbufs;
+	uint64_t hits;
+	uint64_t misses;
+};
+
 struct _server_t {
 	lua_State *L;
+	pool_t pool;
 	uv_tcp_t http_server;
+	uv_timer_t idle;
+	uint64_t timeout;
+	size_t max_body;
+	int stream; // optional callback to choose a body sink per request
+	int chunk; // reusable chunk_t view
+	chunk_t *view;
+	char api [32]; // url prefix dispatched to Lua
+	uint32_t max_age;
 	Inlist *clients;
 	http_parser_settings http_settings;
 	app_t *app;
@@ -47,8 +217,127 @@ struct _client_t {
 	uv_write_t req;
 
 	server_t *server;
+	client_state_t state;
+	int keep_alive;
+	uint64_t last;
+
+	request_t request;
+
+	// response parts pinned until written
+	int refs [PARTS_MAX];
+	unsigned nrefs;
+	shared_t *shared; // or broadcast response
+	char hdr [256]; // status line and headers of native responses but Content-Length
+	char clen [32]; // Content-Length of native responses
+	int pending; // pins client while native response body is read on threadpool
+
+	// buffered request body, reused across requests
+	char *body;
+	size_t nbody;
+	size_t body_size;
+
+	// streaming request body sink, Lua function or io file handle
+	int sink;
+
+	// websocket message callback and opcode of fragmented message in progress
+	int ws;
+	ws_opcode_t ws_opcode;
+
+	// pipelined requests received while a response is pending
+	char *backlog;
+	size_t nbacklog;
 };
 
+static inline char *
+_pool_request(pool_t *pool)
+{
+	if(pool->nbufs)
+	{
+		pool->hits++;
+		return pool->bufs[--pool->nbufs];
+	}
+
+	pool->misses++;
+	return malloc(POOL_BUF_SIZE);
+}
+
+static inline void
+_pool_release(pool_t *pool, char *buf)
+{
+	if(pool->nbufs < POOL_MAX)
+		pool->bufs[pool->nbufs++] = buf;
+	else
+		free(buf); // bound memory held by the pool
+}
+
+static inline void
+_pool_free(pool_t *pool)
+{
+	while(pool->nbufs)
+		free(pool->bufs[--pool->nbufs]);
+}
+
+static inline int
+_request_append(request_t *req, span_t *span, const char *at, size_t len, int lower)
+{
+	if(req->narena + len > ARENA_SIZE)
+	{
+		fprintf(stderr, "_request_append: arena overflow\n");
+		return -1;
+	}
+
+	char *dst = req->arena + req->narena;
+	if(lower)
+	{
+		for(size_t i=0; i<len; i++)
+			dst[i] = tolower(at[i]);
+	}
+	else
+		memcpy(dst, at, len);
+
+	// fragments of the same span are contiguous in the arena
+	if(!span->len)
+		span->offset = req->narena;
+	span->len += len;
+	req->narena += len;
+
+	return 0;
+}
+
+static inline header_id_t
+_request_intern(request_t *req, const span_t *name)
+{
+	const char *str = req->arena + name->offset;
+
+	for(unsigned id=HEADER_UNKNOWN+1; id<HEADER_ID_MAX; id++)
+	{
+		const char *intern = header_names[id];
+
+		if( (strlen(intern) == name->len) && !memcmp(intern, str, name->len) )
+			return id;
+	}
+
+	return HEADER_UNKNOWN;
+}
+
+static inline const char *
+_request_header(request_t *req, header_id_t id, size_t *len)
+{
+	for(unsigned i=0; i<req->nheaders; i++)
+	{
+		header_t *header = &req->headers[i];
+
+		if(header->id == id)
+		{
+			*len = header->value.len;
+			return req->arena + header->value.offset;
+		}
+	}
+
+	*len = 0;
+	return NULL;
+}
+
 static inline void
 _client_remove(client_t *client)
 {
@@ -57,6 +346,24 @@ _client_remove(client_t *client)
 
 	server->clients = inlist_remove(server->clients, INLIST_GET(client));
 
+	if(client->backlog)
+	{
+		free(client->backlog);
+		client->backlog = NULL;
+		client->nbacklog = 0;
+	}
+
+	if(client->body)
+	{
+		free(client->body);
+		client->body = NULL;
+		client->nbody = 0;
+		client->body_size = 0;
+	}
+
+	luaL_unref(L, LUA_REGISTRYINDEX, client->sink);
+	client->sink = LUA_NOREF;
+
 	lua_pushlightuserdata(L, client);
 	lua_pushnil(L);
 	lua_rawset(L, LUA_REGISTRYINDEX);
@@ -66,126 +373,1433 @@ static void
 _on_client_close(uv_handle_t *handle)
 {
 	client_t *client = handle->data;
+	lua_State *L = client->server->L;
+
+	if(client->ws != LUA_NOREF)
+	{
+		// notify websocket callback about disconnection
+		lua_rawgeti(L, LUA_REGISTRYINDEX, client->ws);
+		lua_pushlightuserdata(L, client);
+		lua_rawget(L, LUA_REGISTRYINDEX);
+		lua_pushnil(L);
+		if(lua_pcall(L, 2, 0, 0))
+		{
+			fprintf(stderr, "_on_client_close: %s\n", lua_tostring(L, -1));
+			lua_pop(L, 1);
+		}
+
+		luaL_unref(L, LUA_REGISTRYINDEX, client->ws);
+		client->ws = LUA_NOREF;
+	}
 
 	_client_remove(client);
 }
 
+static void
+_client_close(client_t *client)
+{
+	uv_handle_t *handle = (uv_handle_t *)&client->handle;
+	int err;
+
+	if(uv_is_closing(handle))
+		return;
+
+	if((err = uv_read_stop((uv_stream_t *)handle)))
+		fprintf(stderr, "uv_read_stop: %s\n", uv_strerror(err));
+	uv_close(handle, _on_client_close);
+}
+
+static int
+_client_backlog(client_t *client, const char *at, size_t len)
+{
+	if(client->nbacklog + len > BACKLOG_MAX)
+	{
+		fprintf(stderr, "_client_backlog: overflow\n");
+		return -1;
+	}
+
+	char *backlog = realloc(client->backlog, client->nbacklog + len);
+	if(!backlog)
+		return -1;
+
+	memcpy(backlog + client->nbacklog, at, len);
+	client->backlog = backlog;
+	client->nbacklog += len;
+
+	return 0;
+}
+
+static int
+_client_parse(client_t *client, const char *at, size_t len)
+{
+	server_t *server = client->server;
+
+	size_t parsed = http_parser_execute(&client->parser, &server->http_settings, at, len);
+	enum http_errno err = HTTP_PARSER_ERRNO(&client->parser);
+
+	if(err == HPE_PAUSED)
+	{
+		// parser is paused until response is written, keep pipelined remainder
+		if( (parsed < len) && client->keep_alive )
+			return _client_backlog(client, at + parsed, len - parsed);
+	}
+	else if( (err != HPE_OK) || (parsed < len) )
+	{
+		fprintf(stderr, "_client_parse: %s\n", http_errno_description(err));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+_client_unpin(client_t *client)
+{
+	lua_State *L = client->server->L;
+
+	for(unsigned i=0; i<client->nrefs; i++)
+		luaL_unref(L, LUA_REGISTRYINDEX, client->refs[i]);
+	client->nrefs = 0;
+}
+
 static void
 _after_write(uv_write_t *req, int status)
 {
 	uv_tcp_t *handle = (uv_tcp_t *)req->handle;
-	//client_t *client = handle->data;
+	client_t *client = handle->data;
+	server_t *server = client->server;
+
+	_client_unpin(client);
+
+	if(client->shared) // broadcast response
+	{
+		if(--client->shared->refs == 0)
+			free(client->shared);
+		client->shared = NULL;
+	}
+
+	if(req->data) // native response body
+	{
+		zip_release(server->app, req->data);
+		req->data = NULL;
+	}
+
+	if(status || !client->keep_alive)
+	{
+		_client_close(client);
+		return;
+	}
+
+	// ready for next request on this connection
+	client->state = CLIENT_IDLE;
+	client->last = uv_now(server->app->loop);
+	http_parser_pause(&client->parser, 0);
+
+	if(client->backlog)
+	{
+		char *backlog = client->backlog;
+		size_t nbacklog = client->nbacklog;
+
+		client->backlog = NULL;
+		client->nbacklog = 0;
+
+		if(_client_parse(client, backlog, nbacklog))
+			_client_close(client);
+
+		free(backlog);
+	}
+}
+
+static int
+_client_send(lua_State *L)
+{
+	client_t *client = luaL_checkudata(L, 1, "client_t");
 	//server_t *server = client->server;
+	int nparts = lua_gettop(L) - 1;
+	uv_buf_t msg [PARTS_MAX];
+	int err;
+
+	luaL_argcheck(L, (nparts > 0) && (nparts <= PARTS_MAX), 2, "invalid number of response parts");
+
+	// scatter-gather parts directly from Lua strings, without copying
+	for(int i=0; i<nparts; i++)
+	{
+		size_t size;
+		const char *part = luaL_checklstring(L, i + 2, &size);
+		msg[i] = uv_buf_init((char *)part, size);
+	}
+
+	// only one response per request, ignore closed connections
+	if( (client->state != CLIENT_BUSY) || uv_is_closing((uv_handle_t *)&client->handle) )
+		return 0;
+
+	// pin parts in registry until _after_write
+	for(int i=0; i<nparts; i++)
+	{
+		lua_pushvalue(L, i + 2);
+		client->refs[i] = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+	client->nrefs = nparts;
+
+	client->state = CLIENT_WRITING;
+	if((err = uv_write(&client->req, (uv_stream_t *)&client->handle, msg, nparts, _after_write)))
+	{
+		fprintf(stderr, "uv_write: %s\n", uv_strerror(err));
+		_client_unpin(client);
+		_client_close(client);
+	}
+
+	return 0;
+}
+
+static void
+_client_reject(client_t *client, const char *response, size_t len)
+{
+	http_parser *parser = &client->parser;
+	lua_State *L = client->server->L;
 	int err;
 
-	if(req->data)
-		free(req->data);
+	// free temporary table and sink
+	lua_pushlightuserdata(L, parser);
+	lua_pushnil(L);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+
+	luaL_unref(L, LUA_REGISTRYINDEX, client->sink);
+	client->sink = LUA_NOREF;
+
+	// stop parsing, remaining request data is discarded
+	http_parser_pause(parser, 1);
+	client->keep_alive = 0;
 
-	if(uv_is_active((uv_handle_t *)handle))
+	if(uv_is_closing((uv_handle_t *)&client->handle))
+		return;
+
+	const uv_buf_t msg = uv_buf_init((char *)response, len);
+
+	client->state = CLIENT_WRITING;
+	if((err = uv_write(&client->req, (uv_stream_t *)&client->handle, &msg, 1, _after_write)))
 	{
-		if((err = uv_read_stop((uv_stream_t *)handle)))
-			fprintf(stderr, "uv_read_stop: %s\n", uv_strerror(err));
-		uv_close((uv_handle_t *)handle, _on_client_close);
+		fprintf(stderr, "uv_write: %s\n", uv_strerror(err));
+		_client_close(client);
 	}
 }
 
+static void
+_after_event(uv_write_t *req, int status)
+{
+	write_t *wr = (write_t *)req;
+	client_t *client = req->handle->data;
+	lua_State *L = client->server->L;
+
+	const int close = wr->close;
+
+	luaL_unref(L, LUA_REGISTRYINDEX, wr->refs[0]);
+	luaL_unref(L, LUA_REGISTRYINDEX, wr->refs[1]);
+	if(wr->data)
+		free(wr->data);
+	free(wr);
+
+	if(status || close)
+		_client_close(client);
+}
+
 static int
-_client_send(lua_State *L)
+_client_detached_write(client_t *client, write_t *wr, const uv_buf_t *msg, unsigned nmsg)
+{
+	lua_State *L = client->server->L;
+	int err;
+
+	if((err = uv_write(&wr->req, (uv_stream_t *)&client->handle, msg, nmsg, _after_event)))
+	{
+		fprintf(stderr, "uv_write: %s\n", uv_strerror(err));
+		luaL_unref(L, LUA_REGISTRYINDEX, wr->refs[0]);
+		luaL_unref(L, LUA_REGISTRYINDEX, wr->refs[1]);
+		if(wr->data)
+			free(wr->data);
+		free(wr);
+		_client_close(client);
+		return -1;
+	}
+
+	client->last = uv_now(client->server->app->loop);
+
+	return 0;
+}
+
+static int
+_client_ping(client_t *client)
+{
+	write_t *wr = calloc(1, sizeof(write_t));
+	if(!wr)
+		return -1;
+	wr->refs[0] = LUA_NOREF;
+	wr->refs[1] = LUA_NOREF;
+
+	const uv_buf_t msg = uv_buf_init((char *)event_ping, sizeof(event_ping) - 1);
+
+	return _client_detached_write(client, wr, &msg, 1);
+}
+
+// write data at index idx with optional event name at idx+1 as event frame
+static int
+_client_event(client_t *client, lua_State *L, int idx)
+{
+	size_t len;
+	const char *data = luaL_checklstring(L, idx, &len);
+	size_t nlen = 0;
+	const char *name = luaL_optlstring(L, idx + 1, NULL, &nlen);
+	uv_buf_t msg [6];
+	unsigned nmsg = 0;
+
+	luaL_argcheck(L, !name || !memchr(name, '\n', nlen), idx + 1, "invalid event name");
+
+	if( (client->state != CLIENT_EVENTS) || uv_is_closing((uv_handle_t *)&client->handle) )
+		return -1;
+
+	// drop slow clients once their backlog is full
+	if(client->handle.write_queue_size > EVENT_BACKLOG_MAX)
+	{
+		fprintf(stderr, "_client_event: backlog overflow\n");
+		_client_close(client);
+		return -1;
+	}
+
+	write_t *wr = calloc(1, sizeof(write_t));
+	if(!wr)
+		return -1;
+	wr->refs[0] = LUA_NOREF;
+	wr->refs[1] = LUA_NOREF;
+
+	if(name)
+	{
+		msg[nmsg++] = uv_buf_init("event: ", 7);
+		msg[nmsg++] = uv_buf_init((char *)name, nlen);
+		msg[nmsg++] = uv_buf_init("\n", 1);
+
+		lua_pushvalue(L, idx + 1);
+		wr->refs[1] = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+
+	if(!memchr(data, '\n', len)) // single line, write without copying
+	{
+		msg[nmsg++] = uv_buf_init("data: ", 6);
+		msg[nmsg++] = uv_buf_init((char *)data, len);
+		msg[nmsg++] = uv_buf_init("\n\n", 2);
+
+		lua_pushvalue(L, idx);
+		wr->refs[0] = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+	else // multiple lines, each needs its own field
+	{
+		size_t nlines = 1;
+		for(const char *ptr = data; (ptr = memchr(ptr, '\n', data + len - ptr)); ptr++)
+			nlines++;
+
+		char *dst = malloc(len + nlines*7 + 1);
+		if(!dst)
+		{
+			luaL_unref(L, LUA_REGISTRYINDEX, wr->refs[1]);
+			free(wr);
+			return -1;
+		}
+		wr->data = dst;
+
+		const char *src = data;
+		const char *end = data + len;
+		while(src <= end)
+		{
+			const char *eol = memchr(src, '\n', end - src);
+			if(!eol)
+				eol = end;
+
+			memcpy(dst, "data: ", 6);
+			dst += 6;
+			memcpy(dst, src, eol - src);
+			dst += eol - src;
+			*dst++ = '\n';
+
+			src = eol + 1;
+		}
+		*dst++ = '\n';
+
+		msg[nmsg++] = uv_buf_init(wr->data, dst - wr->data);
+	}
+
+	return _client_detached_write(client, wr, msg, nmsg);
+}
+
+static int
+_client_events(lua_State *L)
+{
+	client_t *client = luaL_checkudata(L, 1, "client_t");
+
+	if( (client->state != CLIENT_BUSY) || uv_is_closing((uv_handle_t *)&client->handle) )
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+
+	write_t *wr = calloc(1, sizeof(write_t));
+	if(!wr)
+	{
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	wr->refs[0] = LUA_NOREF;
+	wr->refs[1] = LUA_NOREF;
+
+	// connection stays open for the event stream, further requests are ignored
+	client->state = CLIENT_EVENTS;
+	client->keep_alive = 1;
+
+	const uv_buf_t msg = uv_buf_init((char *)http_events, sizeof(http_events) - 1);
+
+	lua_pushboolean(L, !_client_detached_write(client, wr, &msg, 1));
+	return 1;
+}
+
+static int
+_client_send_event(lua_State *L)
+{
+	client_t *client = luaL_checkudata(L, 1, "client_t");
+
+	lua_pushboolean(L, !_client_event(client, L, 2));
+	return 1;
+}
+
+static void
+_sha1(const uint8_t *msg, size_t len, uint8_t digest [20])
+{
+	uint32_t h [5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+	const uint64_t bits = (uint64_t)len * 8;
+	const size_t total = ( (len + 8) / 64 + 1) * 64; // padded length
+	uint8_t block [64];
+	uint32_t w [80];
+
+	for(size_t offset = 0; offset < total; offset += 64)
+	{
+		// message, 0x80 terminator, zero padding and big-endian bit length
+		for(unsigned i=0; i<64; i++)
+		{
+			const size_t pos = offset + i;
+
+			if(pos < len)
+				block[i] = msg[pos];
+			else if(pos == len)
+				block[i] = 0x80;
+			else if(pos >= total - 8)
+				block[i] = bits >> ( (total - 1 - pos) * 8);
+			else
+				block[i] = 0x0;
+		}
+
+		for(unsigned i=0; i<16; i++)
+			w[i] = (block[i*4] << 24) | (block[i*4+1] << 16) | (block[i*4+2] << 8) | block[i*4+3];
+		for(unsigned i=16; i<80; i++)
+		{
+			const uint32_t v = w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16];
+			w[i] = (v << 1) | (v >> 31);
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for(unsigned i=0; i<80; i++)
+		{
+			uint32_t f, k;
+
+			if(i < 20)
+			{
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			}
+			else if(i < 40)
+			{
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			}
+			else if(i < 60)
+			{
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			}
+			else
+			{
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+
+			const uint32_t t = ( (a << 5) | (a >> 27) ) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = (b << 30) | (b >> 2);
+			b = a;
+			a = t;
+		}
+
+		h[0] += a;
+		h[1] += b;
+		h[2] += c;
+		h[3] += d;
+		h[4] += e;
+	}
+
+	for(unsigned i=0; i<5; i++)
+	{
+		digest[i*4] = h[i] >> 24;
+		digest[i*4+1] = h[i] >> 16;
+		digest[i*4+2] = h[i] >> 8;
+		digest[i*4+3] = h[i];
+	}
+}
+
+static size_t
+_base64(const uint8_t *src, size_t len, char *dst)
+{
+	static const char lut [] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	char *ptr = dst;
+
+	for(size_t i=0; i<len; i+=3)
+	{
+		const uint32_t v = (src[i] << 16)
+			| (i+1 < len ? src[i+1] << 8 : 0)
+			| (i+2 < len ? src[i+2] : 0);
+
+		*ptr++ = lut[(v >> 18) & 0x3f];
+		*ptr++ = lut[(v >> 12) & 0x3f];
+		*ptr++ = i+1 < len ? lut[(v >> 6) & 0x3f] : '=';
+		*ptr++ = i+2 < len ? lut[v & 0x3f] : '=';
+	}
+
+	return ptr - dst;
+}
+
+static inline int
+_strncaseeq(const char *a, const char *b, size_t len)
+{
+	for(size_t i=0; i<len; i++)
+		if(tolower(a[i]) != tolower(b[i]))
+			return 0;
+
+	return 1;
+}
+
+// write websocket frame, payload is either pinned at Lua index idx or copied
+static int
+_ws_send(client_t *client, lua_State *L, ws_opcode_t opcode, const char *payload,
+	size_t len, int idx)
+{
+	if( (client->state != CLIENT_WEBSOCKET) || uv_is_closing((uv_handle_t *)&client->handle) )
+		return -1;
+
+	// drop slow clients once their backlog is full
+	if(client->handle.write_queue_size > EVENT_BACKLOG_MAX)
+	{
+		fprintf(stderr, "_ws_send: backlog overflow\n");
+		_client_close(client);
+		return -1;
+	}
+
+	write_t *wr = calloc(1, sizeof(write_t));
+	if(!wr)
+		return -1;
+	wr->refs[0] = LUA_NOREF;
+	wr->refs[1] = LUA_NOREF;
+
+	// server frames are unmasked and never fragmented
+	size_t nhdr = 0;
+	wr->hdr[nhdr++] = 0x80 | opcode;
+	if(len < 126)
+		wr->hdr[nhdr++] = len;
+	else if(len <= 0xffff)
+	{
+		wr->hdr[nhdr++] = 126;
+		wr->hdr[nhdr++] = len >> 8;
+		wr->hdr[nhdr++] = len;
+	}
+	else
+	{
+		wr->hdr[nhdr++] = 127;
+		for(int i=7; i>=0; i--)
+			wr->hdr[nhdr++] = (uint64_t)len >> (i*8);
+	}
+
+	uv_buf_t msg [2];
+	unsigned nmsg = 0;
+	msg[nmsg++] = uv_buf_init((char *)wr->hdr, nhdr);
+
+	if(len)
+	{
+		if(idx)
+		{
+			lua_pushvalue(L, idx);
+			wr->refs[0] = luaL_ref(L, LUA_REGISTRYINDEX);
+		}
+		else
+		{
+			if(!(wr->data = malloc(len)))
+			{
+				free(wr);
+				return -1;
+			}
+			memcpy(wr->data, payload, len);
+			payload = wr->data;
+		}
+
+		msg[nmsg++] = uv_buf_init((char *)payload, len);
+	}
+
+	if(opcode == WS_CLOSE)
+	{
+		client->state = CLIENT_CLOSING;
+		wr->close = 1;
+	}
+
+	return _client_detached_write(client, wr, msg, nmsg);
+}
+
+static void
+_ws_message(client_t *client, const char *payload, size_t len, ws_opcode_t opcode)
+{
+	lua_State *L = client->server->L;
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, client->ws);
+	lua_pushlightuserdata(L, client);
+	lua_rawget(L, LUA_REGISTRYINDEX);
+	lua_pushlstring(L, payload, len);
+	lua_pushboolean(L, opcode == WS_BINARY);
+	if(lua_pcall(L, 3, 0, 0))
+	{
+		fprintf(stderr, "_ws_message: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
+static int
+_ws_close(client_t *client, uint16_t status)
+{
+	const char payload [2] = {status >> 8, status & 0xff};
+
+	return _ws_send(client, NULL, WS_CLOSE, payload, sizeof(payload), 0);
+}
+
+static int
+_ws_frame(client_t *client, int fin, ws_opcode_t opcode, const char *payload, size_t len)
+{
+	server_t *server = client->server;
+
+	switch(opcode)
+	{
+		case WS_CLOSE:
+		{
+			uint16_t status = len >= 2
+				? ( (uint8_t)payload[0] << 8) | (uint8_t)payload[1]
+				: 1000;
+			_ws_close(client, status);
+			return 0;
+		}
+		case WS_PING:
+			return _ws_send(client, NULL, WS_PONG, payload, len, 0);
+		case WS_PONG:
+			return 0;
+
+		case WS_TEXT:
+		case WS_BINARY:
+		{
+			if(client->ws_opcode != WS_CONTINUATION) // fragmented message in progress
+				return -1;
+
+			if(fin) // unfragmented message, deliver from read buffer
+			{
+				_ws_message(client, payload, len, opcode);
+				return 0;
+			}
+
+			client->ws_opcode = opcode;
+			client->nbody = 0;
+		}	// fall-through
+		case WS_CONTINUATION:
+		{
+			if(client->ws_opcode == WS_CONTINUATION)
+				return -1;
+
+			if(client->nbody + len > server->max_body)
+			{
+				_ws_close(client, 1009); // message too big
+				return 0;
+			}
+
+			if(client->nbody + len > client->body_size)
+			{
+				size_t body_size = client->body_size ? client->body_size : 0x400;
+				while(body_size < client->nbody + len)
+					body_size <<= 1;
+
+				char *body = realloc(client->body, body_size);
+				if(!body)
+					return -1;
+
+				client->body = body;
+				client->body_size = body_size;
+			}
+
+			memcpy(client->body + client->nbody, payload, len);
+			client->nbody += len;
+
+			if(fin)
+			{
+				_ws_message(client, client->body, client->nbody, client->ws_opcode);
+				client->ws_opcode = WS_CONTINUATION;
+				client->nbody = 0;
+			}
+
+			return 0;
+		}
+	}
+
+	return -1; // reserved opcode
+}
+
+// parse complete frames, returns number of bytes consumed or -1 on error
+static ssize_t
+_ws_parse(client_t *client, char *buf, size_t len)
+{
+	size_t consumed = 0;
+
+	while(consumed + 2 <= len)
+	{
+		uint8_t *ptr = (uint8_t *)buf + consumed;
+		const size_t avail = len - consumed;
+		const int fin = ptr[0] & 0x80;
+		const ws_opcode_t opcode = ptr[0] & 0x0f;
+		size_t nhdr = 2;
+		uint64_t plen = ptr[1] & 0x7f;
+
+		if( (ptr[0] & 0x70) || !(ptr[1] & 0x80) ) // no extensions, clients must mask
+			return -1;
+
+		if( (opcode & 0x8) && (!fin || (plen > 125)) ) // invalid control frame
+			return -1;
+
+		if(plen == 126)
+		{
+			if(avail < 4)
+				break;
+			plen = (ptr[2] << 8) | ptr[3];
+			nhdr += 2;
+		}
+		else if(plen == 127)
+		{
+			if(avail < 10)
+				break;
+			plen = 0;
+			for(unsigned i=0; i<8; i++)
+				plen = (plen << 8) | ptr[2+i];
+			nhdr += 8;
+		}
+
+		if(plen > client->server->max_body)
+			return -1;
+
+		const uint8_t *mask = ptr + nhdr;
+		nhdr += 4;
+
+		if(avail < nhdr + plen)
+			break; // incomplete frame
+
+		// unmask in place
+		char *payload = (char *)ptr + nhdr;
+		for(size_t i=0; i<plen; i++)
+			payload[i] ^= mask[i & 0x3];
+
+		if(_ws_frame(client, fin, opcode, payload, plen))
+			return -1;
+
+		consumed += nhdr + plen;
+
+		if(client->state != CLIENT_WEBSOCKET)
+			return len; // closing, discard rest
+	}
+
+	return consumed;
+}
+
+static int
+_ws_feed(client_t *client, char *at, size_t len)
+{
+	if(!client->backlog) // parse directly from read buffer
+	{
+		ssize_t consumed = _ws_parse(client, at, len);
+		if(consumed < 0)
+			return -1;
+
+		// keep incomplete frame
+		if( ( (size_t)consumed < len) && (client->state == CLIENT_WEBSOCKET) )
+		{
+			if(!(client->backlog = malloc(len - consumed)))
+				return -1;
+			memcpy(client->backlog, at + consumed, len - consumed);
+			client->nbacklog = len - consumed;
+		}
+
+		return 0;
+	}
+
+	// append to incomplete frame
+	const size_t max = client->server->max_body + WS_HEADER_MAX;
+	if(client->nbacklog + len > max)
+		return -1;
+
+	char *backlog = realloc(client->backlog, client->nbacklog + len);
+	if(!backlog)
+		return -1;
+	memcpy(backlog + client->nbacklog, at, len);
+	client->backlog = backlog;
+	client->nbacklog += len;
+
+	ssize_t consumed = _ws_parse(client, client->backlog, client->nbacklog);
+	if(consumed < 0)
+		return -1;
+
+	if( ( (size_t)consumed < client->nbacklog) && (client->state == CLIENT_WEBSOCKET) )
+	{
+		memmove(client->backlog, client->backlog + consumed, client->nbacklog - consumed);
+		client->nbacklog -= consumed;
+	}
+	else
+	{
+		free(client->backlog);
+		client->backlog = NULL;
+		client->nbacklog = 0;
+	}
+
+	return 0;
+}
+
+static int
+_client_upgrade(lua_State *L)
+{
+	client_t *client = luaL_checkudata(L, 1, "client_t");
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+	request_t *req = &client->request;
+	const char *upgrade;
+	const char *version;
+	const char *key;
+	size_t len;
+
+	if( (client->state != CLIENT_BUSY) || uv_is_closing((uv_handle_t *)&client->handle) )
+		goto fail;
+
+	// validate handshake
+	if( !(upgrade = _request_header(req, HEADER_UPGRADE, &len))
+		|| (len != 9) || !_strncaseeq(upgrade, "websocket", len) )
+		goto fail;
+
+	if( !(version = _request_header(req, HEADER_SEC_WEBSOCKET_VERSION, &len))
+		|| (len != 2) || strncmp(version, "13", len) )
+		goto fail;
+
+	if( !(key = _request_header(req, HEADER_SEC_WEBSOCKET_KEY, &len))
+		|| (len != 24) )
+		goto fail;
+
+	// Sec-WebSocket-Accept: base64(sha1(key + guid))
+	char accept [24 + sizeof(WS_GUID)];
+	uint8_t digest [20];
+	memcpy(accept, key, 24);
+	memcpy(accept + 24, WS_GUID, sizeof(WS_GUID) - 1);
+	_sha1((const uint8_t *)accept, 24 + sizeof(WS_GUID) - 1, digest);
+
+	write_t *wr = calloc(1, sizeof(write_t));
+	if(!wr)
+		goto fail;
+	wr->refs[0] = LUA_NOREF;
+	wr->refs[1] = LUA_NOREF;
+
+	static const char http_101 [] =
+		"HTTP/1.1 101 Switching Protocols\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Accept: ";
+
+	if(!(wr->data = malloc(sizeof(http_101) - 1 + 28 + 4)))
+	{
+		free(wr);
+		goto fail;
+	}
+
+	char *ptr = wr->data;
+	memcpy(ptr, http_101, sizeof(http_101) - 1);
+	ptr += sizeof(http_101) - 1;
+	ptr += _base64(digest, sizeof(digest), ptr);
+	memcpy(ptr, "\r\n\r\n", 4);
+	ptr += 4;
+
+	const uv_buf_t msg = uv_buf_init(wr->data, ptr - wr->data);
+
+	client->state = CLIENT_WEBSOCKET;
+	client->keep_alive = 1;
+	client->ws_opcode = WS_CONTINUATION;
+	client->nbody = 0;
+
+	lua_pushvalue(L, 2);
+	client->ws = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	if(_client_detached_write(client, wr, &msg, 1))
+		goto fail;
+
+	// frames sent along with the handshake
+	if(client->backlog)
+	{
+		char *backlog = client->backlog;
+		size_t nbacklog = client->nbacklog;
+
+		client->backlog = NULL;
+		client->nbacklog = 0;
+
+		if(_ws_feed(client, backlog, nbacklog))
+			_client_close(client);
+
+		free(backlog);
+	}
+
+	lua_pushboolean(L, 1);
+	return 1;
+
+fail:
+	lua_pushboolean(L, 0);
+	return 1;
+}
+
+static int
+_client_ws_send(lua_State *L)
+{
+	client_t *client = luaL_checkudata(L, 1, "client_t");
+	size_t len;
+	const char *payload = luaL_checklstring(L, 2, &len);
+	const ws_opcode_t opcode = lua_toboolean(L, 3) ? WS_BINARY : WS_TEXT;
+
+	lua_pushboolean(L, !_ws_send(client, L, opcode, payload, len, 2));
+	return 1;
+}
+
+static int
+_client_ws_close(lua_State *L)
+{
+	client_t *client = luaL_checkudata(L, 1, "client_t");
+	uint16_t status = luaL_optinteger(L, 2, 1000);
+
+	lua_pushboolean(L, !_ws_close(client, status));
+	return 1;
+}
+
+static const luaL_Reg lclient [] = {
+	{"__call", _client_send},
+	{"events", _client_events},
+	{"event", _client_send_event},
+	{"upgrade", _client_upgrade},
+	{"send", _client_ws_send},
+	{"close", _client_ws_close},
+	{NULL, NULL}
+};
+
+static int
+_server_gc(lua_State *L)
+{
+	server_t *server = luaL_checkudata(L, 1, "server_t");
+	int err;
+
+	// close http clients
+	Inlist *l;
+	client_t *client;
+	INLIST_FOREACH_SAFE(server->clients, l, client)
+	{
+		if(!uv_is_closing((uv_handle_t *)&client->handle))
+		{
+			if((err = uv_read_stop((uv_stream_t *)&client->handle)))
+				fprintf(stderr, "uv_read_stop: %s\n", uv_strerror(err));
+			uv_close((uv_handle_t *)&client->handle, NULL);
+		}
+
+		_client_remove(client);
+	}
+
+	// deinit idle timer
+	if(!uv_is_closing((uv_handle_t *)&server->idle))
+	{
+		uv_timer_stop(&server->idle);
+		uv_close((uv_handle_t *)&server->idle, NULL);
+	}
+
+	// deinit http server
+	if(uv_is_active((uv_handle_t *)&server->http_server))
+		uv_close((uv_handle_t *)&server->http_server, NULL);
+
+	_pool_free(&server->pool);
+
+	luaL_unref(L, LUA_REGISTRYINDEX, server->stream);
+	server->stream = LUA_NOREF;
+	luaL_unref(L, LUA_REGISTRYINDEX, server->chunk);
+	server->chunk = LUA_NOREF;
+	server->view = NULL;
+
+	lua_pushlightuserdata(L, server);
+	lua_pushnil(L);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+
+	return 0;
+}
+
+static int
+_server_stats(lua_State *L)
+{
+	server_t *server = luaL_checkudata(L, 1, "server_t");
+
+	lua_createtable(L, 0, 4);
+	{
+		lua_pushinteger(L, server->pool.hits);
+		lua_setfield(L, -2, "pool_hits");
+
+		lua_pushinteger(L, server->pool.misses);
+		lua_setfield(L, -2, "pool_misses");
+
+		lua_pushinteger(L, server->pool.nbufs);
+		lua_setfield(L, -2, "pool_size");
+
+		lua_pushinteger(L, inlist_count(server->clients));
+		lua_setfield(L, -2, "clients");
+	}
+
+	return 1;
+}
+
+static int
+_server_publish(lua_State *L)
+{
+	server_t *server = luaL_checkudata(L, 1, "server_t");
+	int count = 0;
+
+	// send event to all event stream clients
+	Inlist *l;
+	client_t *client;
+	INLIST_FOREACH_SAFE(server->clients, l, client)
+	{
+		if( (client->state == CLIENT_EVENTS) && !_client_event(client, L, 2) )
+			count++;
+	}
+
+	lua_pushinteger(L, count);
+	return 1;
+}
+
+// send identical response to an array of clients, built once from parts
+static int
+_server_broadcast(lua_State *L)
+{
+	server_t *server = luaL_checkudata(L, 1, "server_t");
+	const int nparts = lua_gettop(L) - 2;
+	size_t len = 0;
+	int count = 0;
+	int err;
+
+	luaL_checktype(L, 2, LUA_TTABLE);
+	luaL_argcheck(L, nparts > 0, 3, "no response parts");
+
+	for(int i=0; i<nparts; i++)
+	{
+		size_t size;
+		luaL_checklstring(L, i + 3, &size);
+		len += size;
+	}
+
+	shared_t *shared = malloc(sizeof(shared_t) + len);
+	if(!shared)
+		return luaL_error(L, "out of memory");
+	shared->refs = 1; // held by us until all writes are queued
+	shared->len = 0;
+
+	for(int i=0; i<nparts; i++)
+	{
+		size_t size;
+		const char *part = lua_tolstring(L, i + 3, &size);
+		memcpy(shared->data + shared->len, part, size);
+		shared->len += size;
+	}
+
+	const lua_Integer n = luaL_len(L, 2);
+	for(lua_Integer i=1; i<=n; i++)
+	{
+		lua_rawgeti(L, 2, i);
+		client_t *client = luaL_testudata(L, -1, "client_t");
+		lua_pop(L, 1);
+
+		// only one response per request, ignore closed connections
+		if( !client || (client->server != server) || (client->state != CLIENT_BUSY)
+			|| uv_is_closing((uv_handle_t *)&client->handle) )
+			continue;
+
+		uv_buf_t msg = uv_buf_init(shared->data, shared->len);
+
+		client->shared = shared;
+		shared->refs++;
+		client->state = CLIENT_WRITING;
+		if((err = uv_write(&client->req, (uv_stream_t *)&client->handle, &msg, 1, _after_write)))
+		{
+			fprintf(stderr, "uv_write: %s\n", uv_strerror(err));
+			shared->refs--;
+			client->shared = NULL;
+			_client_close(client);
+			continue;
+		}
+
+		count++;
+	}
+
+	if(--shared->refs == 0)
+		free(shared);
+
+	lua_pushinteger(L, count);
+	return 1;
+}
+
+static const luaL_Reg lserver [] = {
+	{"__gc", _server_gc},
+	{"close", _server_gc},
+	{"publish", _server_publish},
+	{"broadcast", _server_broadcast},
+	{"stats", _server_stats},
+	{NULL, NULL}
+};
+
+static int
+_request_native(client_t *client)
+{
+	http_parser *parser = &client->parser;
+	request_t *req = &client->request;
+	server_t *server = client->server;
+	const size_t napi = strlen(server->api);
+
+	if(!server->app->io)
+		return 0;
+
+	if( (parser->method != HTTP_GET) && (parser->method != HTTP_HEAD) )
+		return 0;
+
+	// dispatch api urls to Lua
+	if( (req->url.len >= napi) && !strncmp(req->arena + req->url.offset, server->api, napi) )
+		return 0;
+
+	return 1;
+}
+
+// match strong etag against If-None-Match list
+static int
+_etag_match(const char *list, size_t len, const char *etag, size_t netag)
+{
+	const char *end = list + len;
+
+	while(list < end)
+	{
+		while( (list < end) && ( (*list == ' ') || (*list == ',') ) )
+			list++;
+		if(list == end)
+			break;
+
+		const char *sep = memchr(list, ',', end - list);
+		const char *tag = list;
+		const char *tag_end = sep ? sep : end;
+		list = tag_end;
+
+		while( (tag_end > tag) && (tag_end[-1] == ' ') )
+			tag_end--;
+
+		if( (tag_end - tag == 1) && (*tag == '*') )
+			return 1;
+
+		if( (tag_end - tag >= 2) && !strncmp(tag, "W/", 2) ) // weak comparison
+			tag += 2;
+
+		if( ( (size_t)(tag_end - tag) == netag) && !strncmp(tag, etag, netag) )
+			return 1;
+	}
+
+	return 0;
+}
+
+// whether Accept-Encoding list allows gzip
+static int
+_accepts_gzip(const char *list, size_t len)
+{
+	const char *end = list + len;
+
+	while(list < end)
+	{
+		while( (list < end) && ( (*list == ' ') || (*list == ',') ) )
+			list++;
+
+		const char *sep = memchr(list, ',', end - list);
+		const char *coding = list;
+		const char *coding_end = sep ? sep : end;
+		list = coding_end;
+
+		const char *param = memchr(coding, ';', coding_end - coding);
+		const char *name_end = param ? param : coding_end;
+		while( (name_end > coding) && (name_end[-1] == ' ') )
+			name_end--;
+		const size_t nname = name_end - coding;
+
+		if( !( (nname == 4) && _strncaseeq(coding, "gzip", 4) )
+			&& !( (nname == 6) && _strncaseeq(coding, "x-gzip", 6) )
+			&& !( (nname == 1) && (*coding == '*') ) )
+			continue;
+
+		// q=0 explicitly refuses coding
+		if(param)
+		{
+			const char *q = param + 1;
+			while( (q < coding_end) && (*q == ' ') )
+				q++;
+			if( (coding_end - q >= 3) && _strncaseeq(q, "q=0", 3) )
+			{
+				for(q += 3; (q < coding_end) && ( (*q == '.') || (*q == '0') ); q++)
+					;
+				if( (q == coding_end) || (*q == ' ') )
+					continue;
+			}
+		}
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static void
+_client_native_write(client_t *client, uv_buf_t *msg, unsigned nmsg)
+{
+	int err;
+
+	client->state = CLIENT_WRITING;
+	if((err = uv_write(&client->req, (uv_stream_t *)&client->handle, msg, nmsg, _after_write)))
+	{
+		fprintf(stderr, "uv_write: %s\n", uv_strerror(err));
+		if(client->req.data)
+		{
+			zip_release(client->server->app, client->req.data);
+			client->req.data = NULL;
+		}
+		_client_close(client);
+	}
+}
+
+// entry of native response has been read
+static void
+_on_static(app_t *app, const uint8_t *chunk, size_t size, void *data)
 {
-	client_t *client = luaL_checkudata(L, 1, "client_t");
-	//server_t *server = client->server;
+	client_t *client = data;
+	lua_State *L = client->server->L;
+	uv_buf_t msg [3];
+	unsigned nmsg = 0;
 
-	size_t size;
-	const char *chunk= luaL_checklstring(L, -1, &size);
-	lua_pop(L, 1);
+	luaL_unref(L, LUA_REGISTRYINDEX, client->pending);
+	client->pending = LUA_NOREF;
 
-	if(chunk)
+	if(uv_is_closing((uv_handle_t *)&client->handle))
 	{
-		client->req.data = malloc(size);
-		if(!client->req.data)
-			return 0;
-		memcpy(client->req.data, chunk, size);
-
-		uv_buf_t msg = {
-			.base = client->req.data,
-			.len = size
-		};
+		if(chunk)
+			zip_release(app, chunk);
+		return;
+	}
 
-		uv_write(&client->req, (uv_stream_t *)&client->handle, &msg, 1, _after_write);
+	if(!chunk)
+	{
+		// http_500 announces Connection: close, drop pipelined requests
+		_client_reject(client, http_500, sizeof(http_500) - 1);
+		return;
 	}
 
-	return 0;
-}
+	msg[nmsg++] = uv_buf_init(client->hdr, strlen(client->hdr));
+	msg[nmsg++] = uv_buf_init(client->clen,
+		snprintf(client->clen, sizeof(client->clen), "Content-Length: %zu\r\n\r\n", size));
+	if( (client->parser.method != HTTP_HEAD) && size)
+		msg[nmsg++] = uv_buf_init((char *)chunk, size);
 
-static const luaL_Reg lclient [] = {
-	{"__call", _client_send},
-	{NULL, NULL}
-};
+	client->req.data = (void *)chunk;
 
-static int
-_server_gc(lua_State *L)
+	_client_native_write(client, msg, nmsg);
+}
+
+// serve static assets from app bundle without touching Lua
+static void
+_client_static(client_t *client)
 {
-	server_t *server = luaL_checkudata(L, 1, "server_t");
-	int err;
+	server_t *server = client->server;
+	request_t *req = &client->request;
+	const char *url = req->arena + req->url.offset;
+	size_t len = req->url.len;
+	char key [KEY_MAX];
+	uv_buf_t msg [2];
+	unsigned nmsg = 0;
+	const zip_info_t *info;
+
+	// strip query and fragment
+	const char *query = memchr(url, '?', len);
+	if(query)
+		len = query - url;
+	const char *fragment = memchr(url, '#', len);
+	if(fragment)
+		len = fragment - url;
+
+	if( (len == 1) && (url[0] == '/') )
+		len = snprintf(key, KEY_MAX, "index.html");
+	else if( (len > 1) && (len <= KEY_MAX) && (url[0] == '/') )
+	{
+		memcpy(key, url + 1, len - 1);
+		key[--len] = '\0';
+	}
+	else
+		len = 0;
 
-	// close http clients
-	Inlist *l;
-	client_t *client;
-	INLIST_FOREACH_SAFE(server->clients, l, client)
+	if(len && (info = zip_info(server->app, key)))
 	{
-		if(uv_is_active((uv_handle_t *)&client->handle))
+		// deflated entries are passed through as gzip without inflating
+		size_t nae;
+		const char *ae = _request_header(req, HEADER_ACCEPT_ENCODING, &nae);
+		const int gzip = info->deflated && ae && _accepts_gzip(ae, nae);
+
+		// crc32 of entry serves as strong validator, distinct per encoding
+		char etag [16];
+		const size_t netag = snprintf(etag, sizeof(etag),
+			gzip ? "\"%08"PRIx32"-gz\"" : "\"%08"PRIx32"\"", info->crc);
+		const char *vary = info->deflated ? "Vary: Accept-Encoding\r\n" : "";
+
+		// html entry points are always revalidated
+		const char *dot = strrchr(key, '.');
+		const uint32_t max_age = dot && !strcmp(dot, ".html") ? 0 : server->max_age;
+
+		char cache [48];
+		if(max_age)
+			snprintf(cache, sizeof(cache), "max-age=%"PRIu32, max_age);
+		else
+			snprintf(cache, sizeof(cache), "no-cache");
+
+		size_t ninm;
+		const char *inm = _request_header(req, HEADER_IF_NONE_MATCH, &ninm);
+
+		if(inm && _etag_match(inm, ninm, etag, netag))
 		{
-			if((err = uv_read_stop((uv_stream_t *)&client->handle)))
-				fprintf(stderr, "uv_read_stop: %s\n", uv_strerror(err));
-			uv_close((uv_handle_t *)&client->handle, NULL);
+			msg[nmsg++] = uv_buf_init((char *)http_304, sizeof(http_304) - 1);
+			msg[nmsg++] = uv_buf_init(client->hdr,
+				snprintf(client->hdr, sizeof(client->hdr),
+					"%sETag: %s\r\nCache-Control: %s\r\n\r\n", vary, etag, cache));
+		}
+		else
+		{
+			snprintf(client->hdr, sizeof(client->hdr),
+				"HTTP/1.1 200 OK\r\nContent-Type: %s\r\n%s%sETag: %s\r\nCache-Control: %s\r\n",
+				info->mime, gzip ? "Content-Encoding: gzip\r\n" : "", vary, etag, cache);
+
+			// pin client userdata until entry has been read off the loop
+			lua_State *L = server->L;
+			lua_pushlightuserdata(L, client);
+			lua_rawget(L, LUA_REGISTRYINDEX);
+			client->pending = luaL_ref(L, LUA_REGISTRYINDEX);
+
+			zip_acquire_async(server->app, key, gzip, _on_static, client);
+			return;
 		}
-
-		_client_remove(client);
 	}
 
-	// deinit http server
-	if(uv_is_active((uv_handle_t *)&server->http_server))
-		uv_close((uv_handle_t *)&server->http_server, NULL);
+	if(!nmsg)
+		msg[nmsg++] = uv_buf_init((char *)http_404, sizeof(http_404) - 1);
 
-	lua_pushlightuserdata(L, server);
-	lua_pushnil(L);
-	lua_rawset(L, LUA_REGISTRYINDEX);
+	_client_native_write(client, msg, nmsg);
+}
+
+static int
+_on_message_begin(http_parser *parser)
+{
+	client_t *client = parser->data;
+	request_t *req = &client->request;
+
+	req->narena = 0;
+	req->url.offset = 0;
+	req->url.len = 0;
+	req->nheaders = 0;
+	req->state = PARSE_NONE;
+	req->native = 0;
 
 	return 0;
 }
 
-static const luaL_Reg lserver [] = {
-	{"__gc", _server_gc},
-	{"close", _server_gc},
-	{NULL, NULL}
-};
-
 static int
-_on_message_begin(http_parser *parser)
+_on_headers_complete(http_parser *parser)
 {
 	client_t *client = parser->data;
 	server_t *server = client->server;
 	lua_State *L = server->L;
+	request_t *req = &client->request;
 
+	client->nbody = 0;
+
+	if((req->native = _request_native(client)))
+		return 0;
+
+	// build Lua request table once from the arena
 	lua_pushlightuserdata(L, parser);
-	lua_newtable(L);
+	lua_createtable(L, 0, 4);
 
-	lua_newtable(L);
+	lua_pushlstring(L, req->arena + req->url.offset, req->url.len);
+	lua_setfield(L, -2, "url");
+
+	lua_pushstring(L, http_method_str(parser->method));
+	lua_setfield(L, -2, "method");
+
+	lua_createtable(L, 0, req->nheaders);
+	for(unsigned i=0; i<req->nheaders; i++)
+	{
+		header_t *header = &req->headers[i];
+
+		lua_pushlstring(L, req->arena + header->name.offset, header->name.len);
+		lua_pushlstring(L, req->arena + header->value.offset, header->value.len);
+		lua_rawset(L, -3);
+	}
 	lua_setfield(L, -2, "header");
 
 	lua_rawset(L, LUA_REGISTRYINDEX);
 
-	return 0;
-}
+	const int chunked = parser->flags & F_CHUNKED;
+	const uint64_t content_length = parser->content_length;
+	if(!chunked && ( (content_length == 0) || (content_length == ULLONG_MAX) ) )
+		return 0; // no body
 
-static int
-_on_headers_complete(http_parser *parser)
-{
-	//client_t *client = parser->data;
-	//server_t *server = client->server;
-	//lua_State *L = server->L;
+	// ask for a streaming sink for this request body
+	if(server->stream != LUA_NOREF)
+	{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, server->stream);
+
+		lua_pushlightuserdata(L, client);
+		lua_rawget(L, LUA_REGISTRYINDEX);
 
-	// do nothing
+		lua_pushlightuserdata(L, parser);
+		lua_rawget(L, LUA_REGISTRYINDEX);
+
+		if(lua_pcall(L, 2, 1, 0))
+		{
+			fprintf(stderr, "_on_headers_complete: %s\n", lua_tostring(L, -1));
+			lua_pop(L, 1);
+		}
+		else if(lua_isfunction(L, -1) || luaL_testudata(L, -1, LUA_FILEHANDLE))
+		{
+			client->sink = luaL_ref(L, LUA_REGISTRYINDEX);
+			return 0;
+		}
+		else
+			lua_pop(L, 1);
+	}
+
+	// buffered bodies are bounded
+	if(!chunked && (content_length > server->max_body) )
+		_client_reject(client, http_413, sizeof(http_413) - 1);
 
 	return 0;
 }
@@ -197,6 +1811,65 @@ _on_message_complete(http_parser *parser)
 	server_t *server = client->server;
 	lua_State *L = server->L;
 
+	client->state = CLIENT_BUSY;
+	client->keep_alive = http_should_keep_alive(parser);
+
+	if(client->request.native)
+	{
+		client->nbody = 0;
+		_client_static(client);
+
+		// handle pipelined requests in order: pause until response is written
+		http_parser_pause(parser, 1);
+
+		return 0;
+	}
+
+	if(client->sink != LUA_NOREF)
+	{
+		// signal end of stream to sink
+		lua_rawgeti(L, LUA_REGISTRYINDEX, client->sink);
+		if(lua_isfunction(L, -1))
+		{
+			lua_pushnil(L);
+			if(lua_pcall(L, 1, 0, 0))
+			{
+				fprintf(stderr, "_on_message_complete: %s\n", lua_tostring(L, -1));
+				lua_pop(L, 1);
+			}
+		}
+		else
+		{
+			luaL_Stream *stream = lua_touserdata(L, -1);
+			if(stream->closef)
+				fflush(stream->f);
+			lua_pop(L, 1);
+		}
+
+		luaL_unref(L, LUA_REGISTRYINDEX, client->sink);
+		client->sink = LUA_NOREF;
+	}
+	else if(client->nbody)
+	{
+		// hand buffered body to Lua as a single string
+		lua_pushlightuserdata(L, parser);
+		lua_rawget(L, LUA_REGISTRYINDEX);
+
+		lua_pushlstring(L, client->body, client->nbody);
+		lua_setfield(L, -2, "body");
+
+		lua_pop(L, 1);
+	}
+
+	// don't hold on to large bodies between requests
+	if(client->body_size > POOL_BUF_SIZE)
+	{
+		free(client->body);
+		client->body = NULL;
+		client->body_size = 0;
+	}
+	client->nbody = 0;
+
 	lua_pushlightuserdata(L, server);
 	lua_rawget(L, LUA_REGISTRYINDEX);
 	if(!lua_isnil(L, -1))
@@ -221,6 +1894,9 @@ _on_message_complete(http_parser *parser)
 	lua_pushnil(L);
 	lua_rawset(L, LUA_REGISTRYINDEX);
 
+	// handle pipelined requests in order: pause until response is written
+	http_parser_pause(parser, 1);
+
 	return 0;
 }
 
@@ -228,70 +1904,91 @@ static int
 _on_header_field(http_parser *parser, const char *at, size_t len)
 {
 	client_t *client = parser->data;
-	server_t *server = client->server;
-	lua_State *L = server->L;
-
-	lua_pushlightuserdata(L, parser);
-	lua_rawget(L, LUA_REGISTRYINDEX);
+	request_t *req = &client->request;
 
-	lua_getfield(L, -1, "header");
+	if(req->state != PARSE_FIELD) // start of new header
+	{
+		if(req->nheaders >= HEADER_MAX)
+		{
+			fprintf(stderr, "_on_header_field: too many headers\n");
+			return -1;
+		}
 
-	lua_pushlstring(L, at, len);
-	lua_pushboolean(L, 0);
-	lua_rawset(L, -3);
+		header_t *header = &req->headers[req->nheaders++];
+		memset(header, 0, sizeof(header_t));
+		req->state = PARSE_FIELD;
+	}
 
-	lua_pop(L, 2);
+	header_t *header = &req->headers[req->nheaders - 1];
 
-	return 0;
+	return _request_append(req, &header->name, at, len, 1);
 }
 
 static int
 _on_header_value(http_parser *parser, const char *at, size_t len)
 {
 	client_t *client = parser->data;
-	server_t *server = client->server;
-	lua_State *L = server->L;
+	request_t *req = &client->request;
 
-	lua_pushlightuserdata(L, parser);
-	lua_rawget(L, LUA_REGISTRYINDEX);
+	if(!req->nheaders)
+		return -1;
 
-	lua_getfield(L, -1, "header");
-	
-	lua_pushnil(L);
-	while(lua_next(L, -2))
-	{
-		if(lua_type(L, -1) == LUA_TBOOLEAN)
-		{
-			lua_pop(L, 1); // pop false
-			lua_pushlstring(L, at, len);
-			lua_rawset(L, -3);
-			break;
-		}
+	header_t *header = &req->headers[req->nheaders - 1];
 
-		lua_pop(L, 1);
+	if(req->state != PARSE_VALUE) // header name is complete
+	{
+		header->id = _request_intern(req, &header->name);
+		req->state = PARSE_VALUE;
 	}
 
-	lua_pop(L, 2);
-
-	return 0;
+	return _request_append(req, &header->value, at, len, 0);
 }
 
 static int
 _on_url(http_parser *parser, const char *at, size_t len)
 {
 	client_t *client = parser->data;
+	request_t *req = &client->request;
+
+	return _request_append(req, &req->url, at, len, 0);
+}
+
+static int
+_sink_write(client_t *client, const char *at, size_t len)
+{
 	server_t *server = client->server;
 	lua_State *L = server->L;
+	int ret = 0;
 
-	lua_pushlightuserdata(L, parser);
-	lua_rawget(L, LUA_REGISTRYINDEX);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, client->sink);
+	if(lua_isfunction(L, -1))
+	{
+		// pass chunk view instead of creating a Lua string per chunk
+		server->view->at = at;
+		server->view->len = len;
 
-	lua_pushlstring(L, at, len);
-	lua_setfield(L, -2, "url");
+		lua_rawgeti(L, LUA_REGISTRYINDEX, server->chunk);
+		if(lua_pcall(L, 1, 1, 0))
+		{
+			fprintf(stderr, "_sink_write: %s\n", lua_tostring(L, -1));
+			ret = -1;
+		}
+		else if(lua_isboolean(L, -1) && !lua_toboolean(L, -1))
+			ret = -1; // sink refused chunk
+		lua_pop(L, 1);
 
-	lua_pop(L, 1);
+		server->view->at = NULL;
+		server->view->len = 0;
+	}
+	else // C sink
+	{
+		luaL_Stream *stream = lua_touserdata(L, -1);
+		if(!stream->closef || (fwrite(at, 1, len, stream->f) != len) )
+			ret = -1;
+		lua_pop(L, 1);
+	}
 
-	return 0;
+	return ret;
 }
 
 static int
@@ -299,15 +1996,40 @@ _on_body(http_parser *parser, const char *at, size_t len)
 {
 	client_t *client = parser->data;
 	server_t *server = client->server;
-	lua_State *L = server->L;
 
-	lua_pushlightuserdata(L, parser);
-	lua_rawget(L, LUA_REGISTRYINDEX);
+	if(client->sink != LUA_NOREF)
+	{
+		if(_sink_write(client, at, len))
+			_client_reject(client, http_500, sizeof(http_500) - 1);
+
+		return 0;
+	}
 
-	lua_pushlstring(L, at, len);
-	lua_setfield(L, -2, "body");
+	if(client->nbody + len > server->max_body)
+	{
+		_client_reject(client, http_413, sizeof(http_413) - 1);
+		return 0;
+	}
 
-	lua_pop(L, 1);
+	if(client->nbody + len > client->body_size)
+	{
+		size_t body_size = client->body_size ? client->body_size : 0x400;
+		while(body_size < client->nbody + len)
+			body_size <<= 1;
+
+		char *body = realloc(client->body, body_size);
+		if(!body)
+		{
+			_client_reject(client, http_500, sizeof(http_500) - 1);
+			return 0;
+		}
+
+		client->body = body;
+		client->body_size = body_size;
+	}
+
+	memcpy(client->body + client->nbody, at, len);
+	client->nbody += len;
 
 	return 0;
 }
@@ -315,10 +2037,11 @@ _on_body(http_parser *parser, const char *at, size_t len)
 static void
 _on_alloc(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
 {
-	//client_t *client = handle->data;
+	client_t *client = handle->data;
+	server_t *server = client->server;
 
-	buf->base = malloc(suggested_size);
-	buf->len = buf->base ? suggested_size : 0;
+	buf->base = _pool_request(&server->pool);
+	buf->len = buf->base ? POOL_BUF_SIZE : 0;
 }
 
 static void
@@ -327,37 +2050,68 @@ _on_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
 	uv_tcp_t *handle = (uv_tcp_t *)stream;
 	client_t *client = handle->data;
 	server_t *server = client->server;
-	int err;
 
-	if(nread >= 0)
+	if(nread > 0)
 	{
-		ssize_t parsed = http_parser_execute(&client->parser, &server->http_settings, buf->base, nread);
+		client->last = uv_now(server->app->loop);
 
-		if(parsed < nread)
+		if(client->state == CLIENT_WEBSOCKET)
 		{
-			fprintf(stderr, "_on_read: http parse error\n");
-			if(uv_is_active((uv_handle_t *)handle))
+			if(_ws_feed(client, buf->base, nread))
 			{
-				if((err = uv_read_stop((uv_stream_t *)handle)))
-					fprintf(stderr, "uv_read_stop: %s\n", uv_strerror(err));
-				uv_close((uv_handle_t *)handle, _on_client_close);
+				fprintf(stderr, "_on_read: websocket protocol error\n");
+				_client_close(client);
 			}
 		}
+		else if( (client->state == CLIENT_EVENTS) || (client->state == CLIENT_CLOSING) )
+		{
+			// event streams don't take further requests, discard
+		}
+		else if(client->state == CLIENT_IDLE)
+		{
+			if(_client_parse(client, buf->base, nread))
+				_client_close(client);
+		}
+		else if(client->keep_alive) // response pending, queue pipelined requests
+		{
+			if(_client_backlog(client, buf->base, nread))
+				_client_close(client);
+		}
+		// else connection is closed after pending response, discard
 	}
-	else
+	else if(nread < 0)
 	{
 		if(nread != UV_EOF)
 			fprintf(stderr, "_on_read: %s\n", uv_strerror(nread));
-		if(uv_is_active((uv_handle_t *)handle))
-		{
-			if((err = uv_read_stop((uv_stream_t *)handle)))
-				fprintf(stderr, "uv_read_stop: %s\n", uv_strerror(err));
-			uv_close((uv_handle_t *)handle, _on_client_close);
-		}
+		_client_close(client);
 	}
 
+	// data has been parsed or copied to backlog, reuse buffer
 	if(buf->base)
-		free(buf->base);
+		_pool_release(&server->pool, buf->base);
+}
+
+static void
+_on_idle(uv_timer_t *idle)
+{
+	server_t *server = idle->data;
+	uint64_t now = uv_now(idle->loop);
+
+	// close persistent connections without pending requests after timeout
+	Inlist *l;
+	client_t *client;
+	INLIST_FOREACH_SAFE(server->clients, l, client)
+	{
+		if(now - client->last < server->timeout)
+			continue;
+
+		if(client->state == CLIENT_IDLE)
+			_client_close(client);
+		else if( (client->state == CLIENT_EVENTS) && !uv_is_closing((uv_handle_t *)&client->handle) )
+			_client_ping(client); // keep event stream alive, detects dead peers
+		else if(client->state == CLIENT_WEBSOCKET)
+			_ws_send(client, NULL, WS_PING, NULL, 0, 0);
+	}
 }
 
 static void
@@ -398,6 +2152,10 @@ _on_connected(uv_stream_t *handle, int status)
 
 	client->handle.data = client;
 	client->parser.data = client;
+	client->last = uv_now(handle->loop);
+	client->sink = LUA_NOREF;
+	client->ws = LUA_NOREF;
+	client->pending = LUA_NOREF;
 
 	http_parser_init(&client->parser, HTTP_REQUEST);
 
@@ -421,6 +2179,45 @@ _new(lua_State *L)
 	server->L = L;
 
 	server->app = app;
+	server->timeout = IDLE_TIMEOUT * 1000; // s -> ms
+	server->max_body = BODY_MAX;
+	server->stream = LUA_NOREF;
+	snprintf(server->api, sizeof(server->api), "%s", API_PREFIX);
+	server->max_age = MAX_AGE;
+
+	if(lua_istable(L, 3)) // optional server configuration
+	{
+		lua_getfield(L, 3, "timeout");
+		server->timeout = luaL_optnumber(L, -1, IDLE_TIMEOUT) * 1000; // s -> ms
+		lua_pop(L, 1);
+
+		lua_getfield(L, 3, "max_body");
+		server->max_body = luaL_optinteger(L, -1, BODY_MAX);
+		lua_pop(L, 1);
+
+		lua_getfield(L, 3, "max_age");
+		server->max_age = luaL_optinteger(L, -1, MAX_AGE);
+		lua_pop(L, 1);
+
+		lua_getfield(L, 3, "api");
+		if(lua_isstring(L, -1))
+			snprintf(server->api, sizeof(server->api), "%s", lua_tostring(L, -1));
+		lua_pop(L, 1);
+
+		lua_getfield(L, 3, "stream");
+		if(lua_isfunction(L, -1))
+			server->stream = luaL_ref(L, LUA_REGISTRYINDEX);
+		else
+			lua_pop(L, 1);
+	}
+
+	server->view = lua_newuserdata(L, sizeof(chunk_t));
+	if(!server->view)
+		goto fail;
+	memset(server->view, 0, sizeof(chunk_t));
+	luaL_getmetatable(L, "chunk_t");
+	lua_setmetatable(L, -2);
+	server->chunk = luaL_ref(L, LUA_REGISTRYINDEX);
 	server->http_settings.on_message_begin = _on_message_begin;
 	server->http_settings.on_message_complete= _on_message_complete;
 	server->http_settings.on_headers_complete= _on_headers_complete;
@@ -459,6 +2256,19 @@ _new(lua_State *L)
 		goto fail;
 	}
 
+	server->idle.data = server;
+	if((err = uv_timer_init(app->loop, &server->idle)))
+	{
+		fprintf(stderr, "uv_timer_init: %s\n", uv_strerror(err));
+		goto fail;
+	}
+
+	if((err = uv_timer_start(&server->idle, _on_idle, IDLE_INTERVAL, IDLE_INTERVAL)))
+	{
+		fprintf(stderr, "uv_timer_start: %s\n", uv_strerror(err));
+		goto fail;
+	}
+
 	luaL_getmetatable(L, "server_t");
 	lua_setmetatable(L, -2);
 
@@ -473,6 +2283,47 @@ fail:
 	return 1;
 }
 
+static int
+_chunk_len(lua_State *L)
+{
+	chunk_t *chunk = luaL_checkudata(L, 1, "chunk_t");
+
+	lua_pushinteger(L, chunk->len);
+
+	return 1;
+}
+
+static int
+_chunk_tostring(lua_State *L)
+{
+	chunk_t *chunk = luaL_checkudata(L, 1, "chunk_t");
+
+	lua_pushlstring(L, chunk->at ? chunk->at : "", chunk->len);
+
+	return 1;
+}
+
+static int
+_chunk_write(lua_State *L)
+{
+	chunk_t *chunk = luaL_checkudata(L, 1, "chunk_t");
+	luaL_Stream *stream = luaL_checkudata(L, 2, LUA_FILEHANDLE);
+
+	if(!stream->closef || (fwrite(chunk->at, 1, chunk->len, stream->f) != chunk->len) )
+		lua_pushboolean(L, 0);
+	else
+		lua_pushboolean(L, 1);
+
+	return 1;
+}
+
+static const luaL_Reg lchunk [] = {
+	{"__len", _chunk_len},
+	{"__tostring", _chunk_tostring},
+	{"write", _chunk_write},
+	{NULL, NULL}
+};
+
 static const luaL_Reg lhttp [] = {
 	{"new", _new},
 	{NULL, NULL}
@@ -497,6 +2348,13 @@ luaopen_http(app_t *app)
 	luaL_setfuncs(L, lclient, 1);
 	lua_pop(L, 1);
 
+	luaL_newmetatable(L, "chunk_t");
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	lua_pushlightuserdata(L, app);
+	luaL_setfuncs(L, lchunk, 1);
+	lua_pop(L, 1);
+
 	lua_newtable(L);
 	lua_pushlightuserdata(L, app);
 	luaL_setfuncs(L, lhttp, 1);
@@ -16,8 +16,12 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
 
 #include <chimaerad.h>
+#include <mod_enc_common.h>
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -26,76 +30,221 @@
 #	define lua_objlen lua_rawlen
 #endif
 
-#include <cJSON.h>
+#define DEPTH_MAX 64 // max nesting of tables
+#define BATCH_MAX 32 // max elements collected on stack before moved into table
+
+static inline int
+_enc_putc(enc_t *enc, char c)
+{
+	if(mod_enc_grow(enc, 1))
+		return -1;
+
+	enc->buf[enc->len++] = c;
+	return 0;
+}
+
+static int
+_enc_integer(enc_t *enc, lua_Integer i)
+{
+	char tmp [24];
+	char *ptr = tmp + sizeof(tmp);
+	lua_Unsigned u = i < 0 ? 0 - (lua_Unsigned)i : (lua_Unsigned)i;
+
+	do
+	{
+		*--ptr = '0' + u % 10;
+		u /= 10;
+	} while(u);
+
+	if(i < 0)
+		*--ptr = '-';
+
+	return mod_enc_put(enc, ptr, tmp + sizeof(tmp) - ptr);
+}
+
+static int
+_enc_number(enc_t *enc, lua_State *L, int idx)
+{
+	if(lua_isinteger(L, idx))
+		return _enc_integer(enc, lua_tointeger(L, idx));
+
+	const lua_Number d = lua_tonumber(L, idx);
+
+	if(!isfinite(d)) // not representable in JSON
+		return mod_enc_put(enc, "null", 4);
+
+	if( (d == floor(d)) && (fabs(d) < 9007199254740992.0) ) // exact integer < 2^53
+		return _enc_integer(enc, (lua_Integer)d);
+
+	if(mod_enc_grow(enc, 32))
+		return -1;
+	enc->len += snprintf(enc->buf + enc->len, 32, LUA_NUMBER_FMT, d);
+	return 0;
+}
+
+static int
+_enc_string(enc_t *enc, const char *str, size_t len)
+{
+	static const char hex [] = "0123456789abcdef";
+	const char *end = str + len;
+	const char *run = str;
+
+	// reserve for common case without escapes, grows further on demand
+	if(mod_enc_grow(enc, len + 2) || _enc_putc(enc, '"'))
+		return -1;
+
+	for(const char *c = str; c < end; c++)
+	{
+		const unsigned char u = *c;
+		char esc [6];
+		size_t nesc = 2;
+
+		if( (u >= 0x20) && (u != '"') && (u != '\\') )
+			continue;
+
+		esc[0] = '\\';
+		switch(u)
+		{
+			case '"': esc[1] = '"'; break;
+			case '\\': esc[1] = '\\'; break;
+			case '\b': esc[1] = 'b'; break;
+			case '\f': esc[1] = 'f'; break;
+			case '\n': esc[1] = 'n'; break;
+			case '\r': esc[1] = 'r'; break;
+			case '\t': esc[1] = 't'; break;
+			default:
+				esc[1] = 'u';
+				esc[2] = '0';
+				esc[3] = '0';
+				esc[4] = hex[u >> 4];
+				esc[5] = hex[u & 0xf];
+				nesc = 6;
+				break;
+		}
+
+		if(mod_enc_put(enc, run, c - run) || mod_enc_put(enc, esc, nesc))
+			return -1;
+		run = c + 1;
+	}
+
+	if(mod_enc_put(enc, run, end - run) || _enc_putc(enc, '"'))
+		return -1;
+
+	return 0;
+}
 
 // forward declaration
-static cJSON * _encode_item(lua_State *L, int idx);
+static int _encode_item(enc_t *enc, lua_State *L, int idx);
 
-static cJSON *
-_encode_array(lua_State *L, int idx)
+static int
+_encode_array(enc_t *enc, lua_State *L, int idx, size_t n)
 {
-	cJSON *arr = cJSON_CreateArray();
-	idx = idx < 0 ? idx-1 : idx;
+	if(mod_enc_enter(enc, L, idx) || _enc_putc(enc, '['))
+		return -1;
 
-	lua_pushnil(L);
-	while(lua_next(L, idx))
+	for(size_t i=1; i<=n; i++)
 	{
-		int pos = luaL_checkinteger(L, -2);
-		cJSON *item = _encode_item(L, -1);
-		if(item)
-			cJSON_AddItemToArray(arr, item);
-		else
-			fprintf(stderr, " at %i\n", pos);
+		if( (i > 1) && _enc_putc(enc, ',') )
+			return -1;
 
+		lua_rawgeti(L, idx, i);
+		if(!mod_enc_encodable(L, -1, NULL))
+		{
+			fprintf(stderr, "cannot encode %s at %zu\n", luaL_typename(L, -1), i);
+			lua_pop(L, 1);
+			lua_pushnil(L); // keep array positions
+		}
+		if(_encode_item(enc, L, lua_gettop(L)))
+			return -1;
 		lua_pop(L, 1);
 	}
 
-	return arr;
+	mod_enc_leave(enc);
+	return _enc_putc(enc, ']');
 }
 
-static cJSON *
-_encode_object(lua_State *L, int idx)
+static int
+_encode_object(enc_t *enc, lua_State *L, int idx)
 {
-	cJSON *obj = cJSON_CreateObject();
-	idx = idx < 0 ? idx-1 : idx;
+	int first = 1;
+
+	if(mod_enc_enter(enc, L, idx) || _enc_putc(enc, '{'))
+		return -1;
 
 	lua_pushnil(L);
 	while(lua_next(L, idx))
 	{
-		const char *name = luaL_checkstring(L, -2);
-		cJSON *item = _encode_item(L, -1);
-		if(item)
-			cJSON_AddItemToObject(obj, name, item);
-		else
-			fprintf(stderr, " at %s\n", name);
+		const int key = lua_gettop(L) - 1;
+		const int val = key + 1;
+		size_t len;
+		const char *name;
+
+		if(!mod_enc_encodable(L, val, NULL))
+		{
+			fprintf(stderr, "cannot encode %s at %s\n", luaL_typename(L, val),
+				lua_type(L, key) == LUA_TSTRING ? lua_tostring(L, key) : "?");
+			lua_pop(L, 1);
+			continue;
+		}
+
+		if( !first && _enc_putc(enc, ',') )
+			return -1;
+		first = 0;
+
+		switch(lua_type(L, key))
+		{
+			case LUA_TSTRING:
+				name = lua_tolstring(L, key, &len);
+				if(_enc_string(enc, name, len))
+					return -1;
+				break;
+			case LUA_TNUMBER: // quote without converting key in place
+				if(_enc_putc(enc, '"') || _enc_number(enc, L, key) || _enc_putc(enc, '"'))
+					return -1;
+				break;
+			default:
+				enc->err = "invalid object key";
+				return -1;
+		}
+
+		if(_enc_putc(enc, ':') || _encode_item(enc, L, val))
+			return -1;
 
 		lua_pop(L, 1);
 	}
 
-	return obj;
+	mod_enc_leave(enc);
+	return _enc_putc(enc, '}');
 }
 
-static cJSON *
-_encode_item(lua_State *L, int idx)
+static int
+_encode_item(enc_t *enc, lua_State *L, int idx)
 {
+	size_t len;
+	const char *str;
+
 	switch(lua_type(L, idx))
 	{
 		case LUA_TNIL:
-			return cJSON_CreateNull();
+			return mod_enc_put(enc, "null", 4);
 		case LUA_TBOOLEAN:
-			return cJSON_CreateBool(lua_toboolean(L, idx));
+			return lua_toboolean(L, idx)
+				? mod_enc_put(enc, "true", 4)
+				: mod_enc_put(enc, "false", 5);
 		case LUA_TNUMBER:
-			return cJSON_CreateNumber(luaL_checknumber(L, idx));
+			return _enc_number(enc, L, idx);
 		case LUA_TSTRING:
-			return cJSON_CreateString(luaL_checkstring(L, idx));
+			str = lua_tolstring(L, idx, &len);
+			return _enc_string(enc, str, len);
 		case LUA_TTABLE:
-			if(!lua_objlen(L, idx))
-				return _encode_object(L, idx);
+			len = lua_objlen(L, idx);
+			if(!len)
+				return _encode_object(enc, L, idx);
 			else
-				return _encode_array(L, idx);
+				return _encode_array(enc, L, idx, len);
 		default:
-			fprintf(stderr, "cannot encode %s", lua_typename(L, idx));
-			return NULL;
+			enc->err = "cannot encode value";
+			return -1;
 	}
 }
 
@@ -104,15 +253,26 @@ static int
 _encode(lua_State *L)
 {
 	//app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+	enc_t *enc = lua_touserdata(L, lua_upvalueindex(2));
 
 	if(lua_istable(L, 1) && !lua_objlen(L, 1))
 	{
-		cJSON *root = _encode_object(L, 1);
-		char *json = cJSON_PrintUnformatted(root);
-		lua_pushnil(L); // no error
-		lua_pushstring(L, json);
-		free(json);
-		cJSON_Delete(root);
+		lua_settop(L, 1);
+
+		mod_enc_reset(enc);
+
+		if(_encode_object(enc, L, 1))
+		{
+			lua_pushstring(L, enc->err);
+			lua_pushnil(L);
+		}
+		else
+		{
+			lua_pushnil(L); // no error
+			lua_pushlstring(L, enc->buf, enc->len);
+		}
+
+		mod_enc_finish(enc);
 	}
 	else
 	{
@@ -123,86 +283,455 @@ _encode(lua_State *L)
 	return 2;
 }
 
+typedef struct _dec_t dec_t;
+
+// parser state over length-delimited input
+struct _dec_t {
+	const char *buf;
+	const char *ptr;
+	const char *end;
+	unsigned depth;
+	const char *err;
+};
+
+static inline void
+_dec_skip(dec_t *dec)
+{
+	while( (dec->ptr < dec->end)
+		&& ( (*dec->ptr == ' ') || (*dec->ptr == '\t') || (*dec->ptr == '\n') || (*dec->ptr == '\r') ) )
+		dec->ptr++;
+}
+
+static inline int
+_dec_fail(dec_t *dec, const char *err)
+{
+	dec->err = err;
+	return -1;
+}
+
+static int
+_dec_hex4(dec_t *dec, uint32_t *u)
+{
+	if(dec->end - dec->ptr < 4)
+		return _dec_fail(dec, "truncated escape");
+
+	*u = 0;
+	for(unsigned i=0; i<4; i++)
+	{
+		const char c = *dec->ptr++;
+		*u <<= 4;
+		if( (c >= '0') && (c <= '9') )
+			*u |= c - '0';
+		else if( (c >= 'a') && (c <= 'f') )
+			*u |= c - 'a' + 10;
+		else if( (c >= 'A') && (c <= 'F') )
+			*u |= c - 'A' + 10;
+		else
+			return _dec_fail(dec, "invalid unicode escape");
+	}
+
+	return 0;
+}
+
+static int
+_dec_string(dec_t *dec, lua_State *L)
+{
+	const char *run = ++dec->ptr; // skip opening quote
+
+	// fast path: no escapes, push straight from input
+	while( (dec->ptr < dec->end) && (*dec->ptr != '"') && (*dec->ptr != '\\') )
+	{
+		if((unsigned char)*dec->ptr < 0x20)
+			return _dec_fail(dec, "control character in string");
+		dec->ptr++;
+	}
+
+	if(dec->ptr == dec->end)
+		return _dec_fail(dec, "unterminated string");
+
+	if(*dec->ptr == '"')
+	{
+		lua_pushlstring(L, run, dec->ptr - run);
+		dec->ptr++;
+		return 0;
+	}
+
+	// slow path: unescape into buffer, balanced stack use only
+	luaL_Buffer B;
+	luaL_buffinit(L, &B);
+	luaL_addlstring(&B, run, dec->ptr - run);
+
+	while(dec->ptr < dec->end)
+	{
+		const char c = *dec->ptr++;
+		uint32_t u;
+
+		if(c == '"')
+		{
+			luaL_pushresult(&B);
+			return 0;
+		}
+
+		if((unsigned char)c < 0x20)
+			return _dec_fail(dec, "control character in string");
+
+		if(c != '\\')
+		{
+			luaL_addchar(&B, c);
+			continue;
+		}
+
+		if(dec->ptr == dec->end)
+			break;
+
+		switch(*dec->ptr++)
+		{
+			case '"': luaL_addchar(&B, '"'); break;
+			case '\\': luaL_addchar(&B, '\\'); break;
+			case '/': luaL_addchar(&B, '/'); break;
+			case 'b': luaL_addchar(&B, '\b'); break;
+			case 'f': luaL_addchar(&B, '\f'); break;
+			case 'n': luaL_addchar(&B, '\n'); break;
+			case 'r': luaL_addchar(&B, '\r'); break;
+			case 't': luaL_addchar(&B, '\t'); break;
+			case 'u':
+			{
+				if(_dec_hex4(dec, &u))
+					return -1;
+
+				if( (u >= 0xd800) && (u < 0xdc00) ) // high surrogate
+				{
+					uint32_t lo;
+					if( (dec->end - dec->ptr < 2) || (dec->ptr[0] != '\\') || (dec->ptr[1] != 'u') )
+						return _dec_fail(dec, "unpaired surrogate");
+					dec->ptr += 2;
+					if(_dec_hex4(dec, &lo))
+						return -1;
+					if( (lo < 0xdc00) || (lo >= 0xe000) )
+						return _dec_fail(dec, "unpaired surrogate");
+					u = 0x10000 + ((u - 0xd800) << 10) + (lo - 0xdc00);
+				}
+				else if( (u >= 0xdc00) && (u < 0xe000) )
+					return _dec_fail(dec, "unpaired surrogate");
+
+				// encode as utf-8
+				if(u < 0x80)
+					luaL_addchar(&B, u);
+				else if(u < 0x800)
+				{
+					luaL_addchar(&B, 0xc0 | (u >> 6));
+					luaL_addchar(&B, 0x80 | (u & 0x3f));
+				}
+				else if(u < 0x10000)
+				{
+					luaL_addchar(&B, 0xe0 | (u >> 12));
+					luaL_addchar(&B, 0x80 | ((u >> 6) & 0x3f));
+					luaL_addchar(&B, 0x80 | (u & 0x3f));
+				}
+				else
+				{
+					luaL_addchar(&B, 0xf0 | (u >> 18));
+					luaL_addchar(&B, 0x80 | ((u >> 12) & 0x3f));
+					luaL_addchar(&B, 0x80 | ((u >> 6) & 0x3f));
+					luaL_addchar(&B, 0x80 | (u & 0x3f));
+				}
+				break;
+			}
+			default:
+				dec->ptr--;
+				return _dec_fail(dec, "invalid escape");
+		}
+	}
+
+	return _dec_fail(dec, "unterminated string");
+}
+
+static int
+_dec_number(dec_t *dec, lua_State *L)
+{
+	const char *start = dec->ptr;
+	const char *p = start;
+	const char *end = dec->end;
+
+	// validate JSON grammar, lua_stringtonumber is more permissive
+	if( (p < end) && (*p == '-') )
+		p++;
+	if( (p < end) && (*p == '0') )
+		p++;
+	else if( (p < end) && (*p >= '1') && (*p <= '9') )
+		while( (p < end) && (*p >= '0') && (*p <= '9') ) p++;
+	else
+		return _dec_fail(dec, "invalid number");
+
+	if( (p < end) && (*p == '.') )
+	{
+		if( (++p == end) || (*p < '0') || (*p > '9') )
+			return _dec_fail(dec, "invalid number");
+		while( (p < end) && (*p >= '0') && (*p <= '9') ) p++;
+	}
+
+	if( (p < end) && ( (*p == 'e') || (*p == 'E') ) )
+	{
+		p++;
+		if( (p < end) && ( (*p == '+') || (*p == '-') ) )
+			p++;
+		if( (p == end) || (*p < '0') || (*p > '9') )
+			return _dec_fail(dec, "invalid number");
+		while( (p < end) && (*p >= '0') && (*p <= '9') ) p++;
+	}
+
+	char tmp [64];
+	const size_t len = p - start;
+	if(len >= sizeof(tmp))
+		return _dec_fail(dec, "number too long");
+
+	memcpy(tmp, start, len);
+	tmp[len] = '\0';
+
+	// integers stay integers, floats and overflowing integers become floats
+	if(!lua_stringtonumber(L, tmp))
+		return _dec_fail(dec, "invalid number");
+
+	dec->ptr = p;
+	return 0;
+}
+
+static int
+_dec_literal(dec_t *dec, const char *lit, size_t len)
+{
+	if( ((size_t)(dec->end - dec->ptr) < len) || strncmp(dec->ptr, lit, len) )
+		return _dec_fail(dec, "invalid literal");
+
+	dec->ptr += len;
+	return 0;
+}
+
 // forward declaration
-static void _decode_item(lua_State *L, cJSON *item);
+static int _dec_value(dec_t *dec, lua_State *L);
+
+static int
+_dec_enter(dec_t *dec, lua_State *L)
+{
+	if(++dec->depth > DEPTH_MAX)
+		return _dec_fail(dec, "nesting too deep");
+
+	if(!lua_checkstack(L, 2*BATCH_MAX + 4))
+		return _dec_fail(dec, "stack overflow");
 
-static void
-_decode_array(lua_State *L, cJSON *arr)
+	dec->ptr++; // skip opening bracket
+	return 0;
+}
+
+// values are collected on the stack and moved into a table presized to their
+// count, tables with more than BATCH_MAX elements are filled in batches
+static int
+_dec_array(dec_t *dec, lua_State *L)
 {
-	int n = cJSON_GetArraySize(arr);
-	lua_createtable(L, n, 0);
+	if(_dec_enter(dec, L))
+		return -1;
+
+	int tab = 0; // stack index of table once created
+	int n = 0; // elements in table
+	int pending = 0; // elements on stack
 
-	int i = 0;
-	for(cJSON *item = arr->child; item; item = item->next)
+	_dec_skip(dec);
+	if( (dec->ptr < dec->end) && (*dec->ptr == ']') )
 	{
-		_decode_item(L, item);
-		lua_rawseti(L, -2, ++i);
+		dec->ptr++;
+		dec->depth--;
+		lua_createtable(L, 0, 0);
+		return 0;
+	}
+
+	while(1)
+	{
+		if(_dec_value(dec, L))
+			return -1;
+		pending++;
+
+		_dec_skip(dec);
+		const int last = (dec->ptr < dec->end) && (*dec->ptr == ']');
+
+		if( last || (pending == BATCH_MAX) )
+		{
+			if(!tab)
+			{
+				lua_createtable(L, last ? pending : 2*BATCH_MAX, 0);
+				lua_insert(L, -pending - 1);
+				tab = lua_gettop(L) - pending;
+			}
+
+			for(int i=pending; i>0; i--)
+				lua_rawseti(L, tab, n + i);
+			n += pending;
+			pending = 0;
+		}
+
+		if(last)
+		{
+			dec->ptr++;
+			dec->depth--;
+			return 0;
+		}
+
+		if( (dec->ptr == dec->end) || (*dec->ptr != ',') )
+			return _dec_fail(dec, "expected ',' or ']'");
+		dec->ptr++;
+		_dec_skip(dec);
 	}
 }
 
-static void
-_decode_object(lua_State *L, cJSON *obj)
+static int
+_dec_object(dec_t *dec, lua_State *L)
 {
-	int n = cJSON_GetArraySize(obj);
-	lua_createtable(L, 0, n);
+	if(_dec_enter(dec, L))
+		return -1;
+
+	int tab = 0; // stack index of table once created
+	int pending = 0; // key value pairs on stack
+
+	_dec_skip(dec);
+	if( (dec->ptr < dec->end) && (*dec->ptr == '}') )
+	{
+		dec->ptr++;
+		dec->depth--;
+		lua_createtable(L, 0, 0);
+		return 0;
+	}
 
-	for(cJSON *item = obj->child; item; item = item->next)
+	while(1)
 	{
-		_decode_item(L, item);
-		lua_setfield(L, -2, item->string);
+		if( (dec->ptr == dec->end) || (*dec->ptr != '"') )
+			return _dec_fail(dec, "expected string key");
+		if(_dec_string(dec, L))
+			return -1;
+
+		_dec_skip(dec);
+		if( (dec->ptr == dec->end) || (*dec->ptr != ':') )
+			return _dec_fail(dec, "expected ':'");
+		dec->ptr++;
+		_dec_skip(dec);
+
+		if(_dec_value(dec, L))
+			return -1;
+		pending++;
+
+		_dec_skip(dec);
+		const int last = (dec->ptr < dec->end) && (*dec->ptr == '}');
+
+		if( last || (pending == BATCH_MAX) )
+		{
+			if(!tab)
+			{
+				lua_createtable(L, 0, last ? pending : 2*BATCH_MAX);
+				lua_insert(L, -2*pending - 1);
+				tab = lua_gettop(L) - 2*pending;
+			}
+
+			// null values leave keys absent
+			for(int i=0; i<pending; i++)
+			{
+				const int key = tab + 1 + 2*i;
+				lua_pushvalue(L, key);
+				lua_pushvalue(L, key + 1);
+				lua_rawset(L, tab);
+			}
+			lua_settop(L, tab);
+			pending = 0;
+		}
+
+		if(last)
+		{
+			dec->ptr++;
+			dec->depth--;
+			return 0;
+		}
+
+		if( (dec->ptr == dec->end) || (*dec->ptr != ',') )
+			return _dec_fail(dec, "expected ',' or '}'");
+		dec->ptr++;
+		_dec_skip(dec);
 	}
 }
 
-static void
-_decode_item(lua_State *L, cJSON *item)
+static int
+_dec_value(dec_t *dec, lua_State *L)
 {
-	switch(item->type)
+	if(dec->ptr == dec->end)
+		return _dec_fail(dec, "unexpected end of input");
+
+	switch(*dec->ptr)
 	{
-		case cJSON_False:
-			lua_pushboolean(L, 0);
-			break;
-		case cJSON_True:
+		case '{':
+			return _dec_object(dec, L);
+		case '[':
+			return _dec_array(dec, L);
+		case '"':
+			return _dec_string(dec, L);
+		case 't':
+			if(_dec_literal(dec, "true", 4))
+				return -1;
 			lua_pushboolean(L, 1);
-			break;
-		case cJSON_NULL:
+			return 0;
+		case 'f':
+			if(_dec_literal(dec, "false", 5))
+				return -1;
+			lua_pushboolean(L, 0);
+			return 0;
+		case 'n':
+			if(_dec_literal(dec, "null", 4))
+				return -1;
 			lua_pushnil(L);
-			break;
-		case cJSON_Number:
-			lua_pushnumber(L, item->valuedouble);
-			break;
-		case cJSON_String:
-			lua_pushstring(L, item->valuestring);
-			break;
-		case cJSON_Array:
-			_decode_array(L, item);
-			break;
-		case cJSON_Object:
-			_decode_object(L, item);
-			break;
+			return 0;
+		default:
+			return _dec_number(dec, L);
 	}
 }
 
-// JSON -> Lua
+// JSON -> Lua, decodes byte range i..j of string, returns offset on error
 static int
 _decode(lua_State *L)
 {
-	const char *root_str = luaL_checkstring(L, 1);
+	size_t len;
+	const char *str = luaL_checklstring(L, 1, &len);
+	lua_Integer i = luaL_optinteger(L, 2, 1);
+	lua_Integer j = luaL_optinteger(L, 3, len);
 
-	cJSON *root = cJSON_Parse(root_str);
-	if(root)
-	{
-		lua_pushnil(L); // no error
-		_decode_object(L, root);
-		cJSON_Delete(root);
-	}
-	else
+	if(i < 1)
+		i = 1;
+	if(j > (lua_Integer)len)
+		j = len;
+
+	dec_t dec = {
+		.buf = str,
+		.ptr = str + i - 1,
+		.end = i <= j ? str + j : str + i - 1,
+		.depth = 0,
+		.err = NULL
+	};
+
+	lua_settop(L, 3);
+
+	_dec_skip(&dec);
+	if(!_dec_value(&dec, L))
 	{
-		const char *err = cJSON_GetErrorPtr();
-		lua_pushstring(L, err);
-		lua_pushnil(L);
+		_dec_skip(&dec);
+		if(dec.ptr == dec.end)
+		{
+			lua_pushnil(L); // no error
+			lua_insert(L, -2);
+			return 2;
+		}
+
+		dec.err = "trailing characters";
 	}
 
-	return 2;
+	lua_settop(L, 3);
+	lua_pushfstring(L, "%s at offset %d", dec.err, (int)(dec.ptr - dec.buf));
+	lua_pushnil(L);
+	lua_pushinteger(L, dec.ptr - dec.buf);
+
+	return 3;
 }
 
 static const luaL_Reg ljson [] = {
@@ -218,7 +747,8 @@ luaopen_json(app_t *app)
 
 	lua_newtable(L);
 	lua_pushlightuserdata(L, app);
-	luaL_setfuncs(L, ljson, 1);
+	mod_enc_new(L);
+	luaL_setfuncs(L, ljson, 2);
 	lua_setglobal(L, "JSON");
 
 	return 0;
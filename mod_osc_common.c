@@ -21,6 +21,8 @@
 #include <osc.h>
 #include <mod_osc_common.h>
 
+uint32_t mod_osc_gen = 1;
+
 osc_data_t *
 mod_osc_encode(lua_State *L, int pos, osc_data_t *buf, osc_data_t *end)
 {
@@ -55,6 +57,13 @@ mod_osc_encode(lua_State *L, int pos, osc_data_t *buf, osc_data_t *end)
 			}
 			case OSC_BLOB:
 			{
+				mod_borrow_t *bb = luaL_testudata(L, pos, "mod_borrow_t");
+				if(bb && mod_borrow_data(bb))
+				{
+					ptr = osc_set_blob(ptr, end, bb->size, bb->buf);
+					pos++;
+					break;
+				}
 				mod_blob_t *tb = luaL_checkudata(L, pos++, "mod_blob_t");
 				ptr = osc_set_blob(ptr, end, tb->size, tb->buf);
 				break;
@@ -23,12 +23,29 @@
 #include <osc.h>
 
 typedef struct _mod_blob_t mod_blob_t;
+typedef struct _mod_borrow_t mod_borrow_t;
 
 struct _mod_blob_t {
 	int32_t size;
 	uint8_t buf [0];
 };
 
+// blob pointing into a receive buffer, only valid during its callback
+struct _mod_borrow_t {
+	int32_t size;
+	uint32_t gen; // valid while equal to mod_osc_gen
+	const uint8_t *buf;
+};
+
+// generation of current dispatch, bumped when received messages expire
+extern uint32_t mod_osc_gen;
+
+static inline const uint8_t *
+mod_borrow_data(const mod_borrow_t *bb)
+{
+	return bb->gen == mod_osc_gen ? bb->buf : NULL;
+}
+
 osc_data_t *mod_osc_encode(lua_State *L, int pos, osc_data_t *buf, osc_data_t
 *end);
 
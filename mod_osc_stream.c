@@ -17,6 +17,11 @@
 
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__)
+#	include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#	include <arm_neon.h>
+#endif
 
 #include <chimaerad.h>
 
@@ -36,6 +41,46 @@
 
 typedef struct _mod_osc_t mod_osc_t;
 typedef struct _mod_msg_t mod_msg_t;
+typedef struct _osc_handler_t osc_handler_t;
+typedef struct _osc_node_t osc_node_t;
+typedef struct _osc_trie_t osc_trie_t;
+typedef struct _mod_view_t mod_view_t;
+
+struct _osc_handler_t {
+	char *fmt; // type tag without leading ',', NULL matches any
+	int ref;
+};
+
+// one path segment of the method registry, children sorted by name
+struct _osc_node_t {
+	char *name;
+	osc_handler_t *handlers;
+	unsigned nhandlers;
+	osc_node_t *children;
+	unsigned nchildren;
+};
+
+struct _osc_trie_t {
+	lua_State *L;
+	osc_node_t root;
+};
+
+#define VIEW_MAX 32
+#define POOL_MAX 8 // recycled copies per blob size
+#define POOL_SIZE_MAX 0x10000 // larger copies are left to the GC
+#define POOL_BYTES_MAX 0x40000 // total payload held by pool
+#define FRAME_DEPTH 8 // maximal nesting of bundles delivered as frame
+
+// message view, decodes arguments on demand while its callback runs
+struct _mod_view_t {
+	const char *path;
+	const char *fmt;
+	uint32_t gen; // valid while equal to mod_osc_gen
+	osc_time_t time;
+	unsigned nargs;
+	unsigned nscan; // number of resolved argument offsets
+	const osc_data_t *args [VIEW_MAX];
+};
 
 struct _mod_osc_t {
 	lua_State *L;
@@ -43,8 +88,22 @@ struct _mod_osc_t {
 	osc_time_t time;
 	varchunk_t *from_net;
 	varchunk_t *to_net;
+	int dispatching; // from_net is being unrolled, freed after loop
+	osc_trie_t *trie; // native dispatch or NULL to pass all messages to callback
+	int trie_ref;
+	mod_view_t *view; // lazy mode or NULL to push all arguments
+	int view_ref;
+	int frame_ref; // bundle handler or LUA_NOREF to unroll bundles
+	int frame_pool_ref; // table of message views for frames
+	int frame_views_ref; // table passed to bundle handler
+	mod_view_t **frame;
+	unsigned nframe;
+	unsigned frame_size;
 };
 
+static int blob_pool; // registry key of recycled blob copies
+static size_t pool_bytes; // payload currently held by pool
+
 static int
 _call(lua_State *L)
 {
@@ -88,7 +147,8 @@ _gc(lua_State *L)
 		mod_osc->stream = NULL;
 	}
 
-	if(mod_osc->from_net)
+	mod_osc_gen++; // views and borrowed blobs point into from_net
+	if(mod_osc->from_net && !mod_osc->dispatching)
 	{
 		varchunk_free(mod_osc->from_net);
 		mod_osc->from_net = NULL;
@@ -99,6 +159,28 @@ _gc(lua_State *L)
 		varchunk_free(mod_osc->to_net);
 		mod_osc->to_net = NULL;
 	}
+
+	luaL_unref(L, LUA_REGISTRYINDEX, mod_osc->trie_ref);
+	mod_osc->trie_ref = LUA_NOREF;
+	mod_osc->trie = NULL;
+
+	luaL_unref(L, LUA_REGISTRYINDEX, mod_osc->view_ref);
+	mod_osc->view_ref = LUA_NOREF;
+	mod_osc->view = NULL;
+
+	luaL_unref(L, LUA_REGISTRYINDEX, mod_osc->frame_ref);
+	luaL_unref(L, LUA_REGISTRYINDEX, mod_osc->frame_pool_ref);
+	luaL_unref(L, LUA_REGISTRYINDEX, mod_osc->frame_views_ref);
+	mod_osc->frame_ref = LUA_NOREF;
+	mod_osc->frame_pool_ref = LUA_NOREF;
+	mod_osc->frame_views_ref = LUA_NOREF;
+	if(mod_osc->frame)
+	{
+		free(mod_osc->frame);
+		mod_osc->frame = NULL;
+	}
+	mod_osc->frame_size = 0;
+
 	
 	lua_pushlightuserdata(L, mod_osc);
 	lua_pushnil(L);
@@ -123,317 +205,1434 @@ _stamp(osc_time_t tstamp, void *data)
 	mod_osc->time = tstamp;
 }
 
-static void
-_message(const osc_data_t *buf, size_t len, void *data)
+// push new blob, recycled from pool if a copy of that size has been collected
+static mod_blob_t *
+_blob_alloc(lua_State *L, int32_t size)
 {
-	mod_osc_t *mod_osc = data;
-	lua_State *L = mod_osc->L;
-
-	if(!L)
-		return;
-
-	const osc_data_t *ptr = buf;
-	const char *path = NULL;
-	const char *fmt = NULL;
-			
-	lua_pushlightuserdata(L, mod_osc);
+	lua_pushlightuserdata(L, &blob_pool);
 	lua_rawget(L, LUA_REGISTRYINDEX);
-	if(!lua_isnil(L, -1))
+	if(lua_rawgeti(L, -1, size) == LUA_TTABLE)
 	{
-		ptr = osc_get_path(ptr, &path);
-		ptr = osc_get_fmt(ptr, &fmt);
-		fmt++;
-
-		lua_pushnumber(L, mod_osc->time);
-		lua_pushstring(L, path);
-		lua_pushstring(L, fmt);
-
-		for(const char *type = fmt; *type; type++)
-			switch(*type)
+		const lua_Integer n = luaL_len(L, -1);
+		if(n > 0)
+		{
+			lua_rawgeti(L, -1, n);
+			lua_pushnil(L);
+			lua_rawseti(L, -3, n);
+			if(n == 1) // drop empty list, sizes seen once must not pile up
 			{
-				case OSC_INT32:
-				{
-					int32_t i;
-					if((ptr = osc_get_int32(ptr, &i)))
-						lua_pushnumber(L, i);
-					break;
-				}
-				case OSC_FLOAT:
-				{
-					float f;
-					if((ptr = osc_get_float(ptr, &f)))
-						lua_pushnumber(L, f);
-					break;
-				}
-				case OSC_STRING:
-				{
-					const char *s;
-					if((ptr = osc_get_string(ptr, &s)))
-						lua_pushstring(L, s);
-					break;
-				}
-				case OSC_BLOB:
-				{
-					osc_blob_t b;
-					if((ptr = osc_get_blob(ptr, &b)))
-					{
-						mod_blob_t *tb = lua_newuserdata(L, sizeof(mod_blob_t) + b.size);
-						if(tb)
-						{
-							tb->size = b.size;
-							memcpy(tb->buf, b.payload, b.size);
-							
-							luaL_getmetatable(L, "mod_blob_t");
-							lua_setmetatable(L, -2);
-						}
-						else
-							lua_pushnil(L);
-					}
-					break;
-				}
-				
-				case OSC_TIMETAG:
-				{
-					osc_time_t t;
-					if((ptr = osc_get_timetag(ptr, &t)))
-						lua_pushnumber(L, t);
-					break;
-				}
-				case OSC_INT64:
-				{
-					int64_t h;
-					if((ptr = osc_get_int64(ptr, &h)))
-						lua_pushnumber(L, h);
-					break;
-				}
-				case OSC_DOUBLE:
-				{
-					double d;
-					if((ptr = osc_get_double(ptr, &d)))
-						lua_pushnumber(L, d);
-					break;
-				}
-				
-				case OSC_NIL:
-				case OSC_BANG:
-				case OSC_TRUE:
-				case OSC_FALSE:
-					break;
-				
-				case OSC_SYMBOL:
-				{
-					const char *S;
-					if((ptr = osc_get_symbol(ptr, &S)))
-						lua_pushstring(L, S);
-					break;
-				}
-				case OSC_CHAR:
-				{
-					char c;
-					if((ptr = osc_get_char(ptr, &c)))
-						lua_pushnumber(L, c);
-					break;
-				}
-				case OSC_MIDI:
-				{
-					const uint8_t *m;
-					if((ptr = osc_get_midi(ptr, &m)))
-					{
-						lua_createtable(L, 4, 0);
-						lua_pushnumber(L, m[0]);
-						lua_rawseti(L, -2, 1);
-						lua_pushnumber(L, m[1]);
-						lua_rawseti(L, -2, 2);
-						lua_pushnumber(L, m[2]);
-						lua_rawseti(L, -2, 3);
-						lua_pushnumber(L, m[3]);
-						lua_rawseti(L, -2, 4);
-					}
-					break;
-				}
+				lua_pushnil(L);
+				lua_rawseti(L, -4, size);
 			}
+			lua_replace(L, -3); // replace pool with blob
+			lua_pop(L, 1); // list
 
-		if(lua_pcall(L, 3+strlen(fmt), 0, 0))
-		{
-			fprintf(stderr, "_message: %s\n", lua_tostring(L, -1));
-			lua_pop(L, 1); // pop error string
+			pool_bytes -= size;
+			return lua_touserdata(L, -1);
 		}
 	}
-	else
-		lua_pop(L, 1);
-}
+	lua_pop(L, 2); // pool, list
 
-static const osc_unroll_inject_t inject = {
-	.stamp = _stamp,
-	.message = _message,
-	.bundle = NULL
-};
+	mod_blob_t *tb = lua_newuserdata(L, sizeof(mod_blob_t) + size);
+	tb->size = size;
 
-static void *
-_data_recv_req(size_t size, void *data)
-{
-	mod_osc_t *mod_osc = data;
+	luaL_getmetatable(L, "mod_blob_t");
+	lua_setmetatable(L, -2);
 
-	return varchunk_write_request(mod_osc->from_net, size);
+	return tb;
 }
 
+// push fresh handle of blob borrowed from receive buffer, payload is not copied
 static void
-_data_recv_adv(size_t written, void *data)
+_blob_borrow(lua_State *L, const osc_blob_t *b)
 {
-	mod_osc_t *mod_osc = data;
+	mod_borrow_t *bb = lua_newuserdata(L, sizeof(mod_borrow_t));
+	bb->size = b->size;
+	bb->gen = mod_osc_gen;
+	bb->buf = b->payload;
 
-	varchunk_write_advance(mod_osc->from_net, written);
+	luaL_getmetatable(L, "mod_borrow_t");
+	lua_setmetatable(L, -2);
+}
 
-	const osc_data_t *ptr;
-	size_t size;
-	while((ptr = varchunk_read_request(mod_osc->from_net, &size)))
+// invalidate views and borrowed blobs of dispatched message or frame, as
+// message memory is recycled by varchunk
+static void
+_expire(void)
+{
+	mod_osc_gen++;
+}
+
+// push single argument, returns pointer to next argument or NULL
+static const osc_data_t *
+_push_arg(lua_State *L, char type, const osc_data_t *ptr)
+{
+	switch(type)
 	{
-		if(!osc_unroll_packet((osc_data_t *)ptr, size, OSC_UNROLL_MODE_FULL, (osc_unroll_inject_t *)&inject, mod_osc))
-			fprintf(stderr, "invalid OSC packet\n");
+		case OSC_INT32:
+		{
+			int32_t i;
+			if((ptr = osc_get_int32(ptr, &i)))
+				lua_pushnumber(L, i);
+			break;
+		}
+		case OSC_FLOAT:
+		{
+			float f;
+			if((ptr = osc_get_float(ptr, &f)))
+				lua_pushnumber(L, f);
+			break;
+		}
+		case OSC_STRING:
+		{
+			const char *s;
+			if((ptr = osc_get_string(ptr, &s)))
+				lua_pushstring(L, s);
+			break;
+		}
+		case OSC_BLOB:
+		{
+			osc_blob_t b;
+			if((ptr = osc_get_blob(ptr, &b)))
+				_blob_borrow(L, &b);
+			break;
+		}
 
-		varchunk_read_advance(mod_osc->from_net);		
+		case OSC_TIMETAG:
+		{
+			osc_time_t t;
+			if((ptr = osc_get_timetag(ptr, &t)))
+				lua_pushnumber(L, t);
+			break;
+		}
+		case OSC_INT64:
+		{
+			int64_t h;
+			if((ptr = osc_get_int64(ptr, &h)))
+				lua_pushnumber(L, h);
+			break;
+		}
+		case OSC_DOUBLE:
+		{
+			double d;
+			if((ptr = osc_get_double(ptr, &d)))
+				lua_pushnumber(L, d);
+			break;
+		}
+		
+		case OSC_NIL:
+		case OSC_BANG:
+			lua_pushnil(L);
+			break;
+		case OSC_TRUE:
+			lua_pushboolean(L, 1);
+			break;
+		case OSC_FALSE:
+			lua_pushboolean(L, 0);
+			break;
+
+		default:
+			return NULL;
+		
+		case OSC_SYMBOL:
+		{
+			const char *S;
+			if((ptr = osc_get_symbol(ptr, &S)))
+				lua_pushstring(L, S);
+			break;
+		}
+		case OSC_CHAR:
+		{
+			char c;
+			if((ptr = osc_get_char(ptr, &c)))
+				lua_pushnumber(L, c);
+			break;
+		}
+		case OSC_MIDI:
+		{
+			const uint8_t *m;
+			if((ptr = osc_get_midi(ptr, &m)))
+			{
+				lua_createtable(L, 4, 0);
+				lua_pushnumber(L, m[0]);
+				lua_rawseti(L, -2, 1);
+				lua_pushnumber(L, m[1]);
+				lua_rawseti(L, -2, 2);
+				lua_pushnumber(L, m[2]);
+				lua_rawseti(L, -2, 3);
+				lua_pushnumber(L, m[3]);
+				lua_rawseti(L, -2, 4);
+			}
+			break;
+		}
 	}
+
+	return ptr;
 }
 
-static const void *
-_data_send_req(size_t *len, void *data)
+// push arguments of message, one Lua value per type tag
+static int
+_push_args(lua_State *L, const char *fmt, const osc_data_t *ptr)
 {
-	mod_osc_t *mod_osc = data;
+	const int top = lua_gettop(L);
 
-	return varchunk_read_request(mod_osc->to_net, len);
+	if(!lua_checkstack(L, strlen(fmt)))
+		return 0;
+
+	for(const char *type = fmt; *type && ptr; type++)
+		ptr = _push_arg(L, *type, ptr);
+
+	return lua_gettop(L) - top;
 }
 
-static void
-_data_send_adv(void *data)
+// resolve offset of argument idx, caching offsets of the leading arguments
+static const osc_data_t *
+_view_arg(mod_view_t *view, unsigned idx)
 {
-	mod_osc_t *mod_osc = data;
+	if(idx < view->nscan)
+		return view->args[idx];
 
-	varchunk_read_advance(mod_osc->to_net);
+	unsigned i = view->nscan - 1;
+	const osc_data_t *ptr = view->args[i];
+
+	for( ; i < idx; i++)
+	{
+		if(!(ptr = osc_skip(view->fmt[i], ptr)))
+			return NULL;
+
+		if( (i + 1 == view->nscan) && (view->nscan < VIEW_MAX) )
+			view->args[view->nscan++] = ptr;
+	}
+
+	return ptr;
 }
 
 static void
-_data_free(void *data)
+_view_bind(mod_view_t *view, osc_time_t time, const char *path, const char *fmt,
+	const osc_data_t *ptr)
 {
-	mod_osc_t *mod_osc = data;
-
-	mod_osc->stream = NULL;
+	view->path = path;
+	view->fmt = fmt;
+	view->gen = mod_osc_gen;
+	view->time = time;
+	view->nargs = strlen(fmt);
+	view->nscan = 1;
+	view->args[0] = ptr;
 }
 
-static const osc_stream_driver_t driver = {
-	.recv_req = _data_recv_req,
-	.recv_adv = _data_recv_adv,
-	.send_req = _data_send_req,
-	.send_adv = _data_send_adv,
-	.free = _data_free
-};
-
+// match OSC 1.0 address pattern segment against method name
 static int
-_new(lua_State *L)
+_pattern_match(const char *pat, const char *end, const char *str)
 {
-	app_t *app = lua_touserdata(L, lua_upvalueindex(1));
-	const char *url = luaL_checkstring(L, 1);
+	while(pat < end)
+	{
+		switch(*pat)
+		{
+			case '?':
+				if(!*str)
+					return 0;
+				pat++;
+				str++;
+				break;
+
+			case '*':
+				while( (pat < end) && (*pat == '*') )
+					pat++;
+				if(pat == end)
+					return 1;
+				for( ; *str; str++)
+					if(_pattern_match(pat, end, str))
+						return 1;
+				return 0;
+
+			case '[':
+			{
+				const char *set = pat + 1;
+				const int negate = (set < end) && (*set == '!');
+				if(negate)
+					set++;
+				const char *close = memchr(set, ']', end - set);
+				if(!close || !*str)
+					return 0;
+
+				int found = 0;
+				for(const char *c = set; c < close; c++)
+				{
+					if( (c + 2 < close) && (c[1] == '-') )
+					{
+						if( (*str >= c[0]) && (*str <= c[2]) )
+							found = 1;
+						c += 2;
+					}
+					else if(*c == *str)
+						found = 1;
+				}
+				if(found == negate)
+					return 0;
 
-	mod_osc_t *mod_osc = lua_newuserdata(L, sizeof(mod_osc_t));
-	if(!mod_osc)
-		goto fail;
-	memset(mod_osc, 0, sizeof(mod_osc_t));
-	mod_osc->L = L;
-	
-	if(!(mod_osc->from_net = varchunk_new(BUF_SIZE, false) ))
-		goto fail;
-	if(!(mod_osc->to_net = varchunk_new(BUF_SIZE, false)))
-		goto fail;
-	if(!(mod_osc->stream = osc_stream_new(app->loop, url, &driver, mod_osc)))
-		goto fail;
+				pat = close + 1;
+				str++;
+				break;
+			}
 
-	luaL_getmetatable(L, "mod_osc_t");
-	lua_setmetatable(L, -2);
+			case '{':
+			{
+				const char *close = memchr(pat, '}', end - pat);
+				if(!close)
+					return 0;
 
-	lua_pushlightuserdata(L, mod_osc);
-	lua_pushvalue(L, 2); // push callback
-	lua_rawset(L, LUA_REGISTRYINDEX);
+				for(const char *alt = pat + 1; alt <= close; )
+				{
+					const char *sep = memchr(alt, ',', close - alt);
+					const char *alt_end = sep ? sep : close;
+					const size_t len = alt_end - alt;
 
-	return 1;
+					if(!strncmp(str, alt, len) && _pattern_match(close + 1, end, str + len))
+						return 1;
+					alt = alt_end + 1;
+				}
+				return 0;
+			}
 
-fail:
-	lua_pushnil(L);
-	return 1;
+			default:
+				if(*pat != *str)
+					return 0;
+				pat++;
+				str++;
+				break;
+		}
+	}
+
+	return !*str;
 }
 
+// returns -1 if stream has been closed by a handler
 static int
-_blob(lua_State *L)
+_node_call(mod_osc_t *mod_osc, const osc_node_t *node, const char *fmt,
+	const osc_data_t *ptr)
 {
-	int size = luaL_checkinteger(L, 1);
-	mod_blob_t *tb = lua_newuserdata(L, sizeof(mod_blob_t) + size);
-	if(!tb)
-		goto fail;
-	tb->size = size;
-	memset(tb->buf, 0, size);
-	
-	luaL_getmetatable(L, "mod_blob_t");
-	lua_setmetatable(L, -2);
+	lua_State *L = mod_osc->L;
 
-	return 1;
+	for(unsigned i=0; i<node->nhandlers; i++)
+	{
+		const osc_handler_t *handler = &node->handlers[i];
 
-fail:
-	lua_pushnil(L);
-	return 1;
-}
+		if(handler->fmt && strcmp(handler->fmt, fmt))
+			continue;
 
-static const luaL_Reg losc [] = {
-	{"new", _new},
-	{"blob", _blob},
-	{NULL, NULL}
-};
+		lua_rawgeti(L, LUA_REGISTRYINDEX, handler->ref);
+		lua_pushlightuserdata(L, mod_osc);
+		lua_rawget(L, LUA_REGISTRYINDEX); // responder
+
+		int nargs;
+		if(mod_osc->view)
+		{
+			lua_rawgeti(L, LUA_REGISTRYINDEX, mod_osc->view_ref);
+			nargs = 1;
+		}
+		else
+		{
+			lua_pushnumber(L, mod_osc->time);
+			nargs = 1 + _push_args(L, fmt, ptr);
+		}
+
+		if(lua_pcall(L, 1 + nargs, 0, 0))
+		{
+			fprintf(stderr, "_message: %s\n", lua_tostring(L, -1));
+			lua_pop(L, 1); // pop error string
+		}
+
+		if(!mod_osc->trie) // node belongs to a trie which may be collected
+			return -1;
+	}
+
+	return 0;
+}
 
 static int
-_blob_index(lua_State *L)
+_node_cmp(const void *a, const void *b)
 {
-	mod_blob_t *tb = luaL_checkudata(L, 1, "mod_blob_t");
+	const osc_node_t *A = a;
+	const osc_node_t *B = b;
 
-	int typ = lua_type(L, 2);
-	if(typ == LUA_TNUMBER)
+	return strcmp(A->name, B->name);
+}
+
+static const osc_node_t *
+_node_find(const osc_node_t *node, const char *name, size_t len)
+{
+	unsigned lo = 0;
+	unsigned hi = node->nchildren;
+
+	while(lo < hi)
 	{
-		int index = luaL_checkinteger(L, 2);
-		if( (index >= 0) && (index < tb->size) )
-			lua_pushnumber(L, tb->buf[index]);
+		const unsigned mid = (lo + hi) / 2;
+		const osc_node_t *child = &node->children[mid];
+		int cmp = strncmp(name, child->name, len);
+		if(!cmp && child->name[len])
+			cmp = -1; // name is a prefix of child
+
+		if(!cmp)
+			return child;
+		else if(cmp < 0)
+			hi = mid;
 		else
-			lua_pushnil(L);
+			lo = mid + 1;
 	}
-	else if( (typ == LUA_TSTRING) && !strcmp(lua_tostring(L, 2), "raw") )
-		lua_pushlightuserdata(L, tb->buf);
-	else
-		lua_pushnil(L);
 
-	return 1;
+	return NULL;
 }
 
+// walk trie segment by segment, patterns may resolve to several methods
 static int
-_blob_newindex(lua_State *L)
+_trie_dispatch(mod_osc_t *mod_osc, const osc_node_t *node, const char *path,
+	const char *fmt, const osc_data_t *ptr)
 {
-	mod_blob_t *tb = luaL_checkudata(L, 1, "mod_blob_t");
-	int index = luaL_checkinteger(L, 2);
+	const char *sep = strchr(path, '/');
+	const char *end = sep ? sep : path + strlen(path);
 
-	if( (index >= 0) && (index < tb->size) )
-		tb->buf[index] = luaL_checkinteger(L, 3);
+	if(strpbrk(path, "*?[{") && (strpbrk(path, "*?[{") < end))
+	{
+		for(unsigned i=0; i<node->nchildren; i++)
+		{
+			const osc_node_t *child = &node->children[i];
 
-	return 0;
-}
+			if(!_pattern_match(path, end, child->name))
+				continue;
 
-static int
-_blob_len(lua_State *L)
-{
-	mod_blob_t *tb = luaL_checkudata(L, 1, "mod_blob_t");
+			if(sep ? _trie_dispatch(mod_osc, child, sep + 1, fmt, ptr)
+				: _node_call(mod_osc, child, fmt, ptr))
+				return -1;
+		}
+	}
+	else
+	{
+		const osc_node_t *child = _node_find(node, path, end - path);
 
-	lua_pushnumber(L, tb->size);
+		if(!child)
+			return 0;
 
-	return 1;
+		if(sep)
+			return _trie_dispatch(mod_osc, child, sep + 1, fmt, ptr);
+		return _node_call(mod_osc, child, fmt, ptr);
+	}
+
+	return 0;
+}
+
+static void
+_message(const osc_data_t *buf, size_t len, void *data)
+{
+	mod_osc_t *mod_osc = data;
+	lua_State *L = mod_osc->L;
+
+	if(!L || !mod_osc->stream) // closed by handler of previous message
+		return;
+
+	const osc_data_t *ptr = buf;
+	const char *path = NULL;
+	const char *fmt = NULL;
+
+	ptr = osc_get_path(ptr, &path);
+	ptr = osc_get_fmt(ptr, &fmt);
+	fmt++;
+
+	if(mod_osc->view)
+		_view_bind(mod_osc->view, mod_osc->time, path, fmt, ptr);
+
+	if(mod_osc->trie)
+	{
+		if(path[0] == '/')
+			_trie_dispatch(mod_osc, &mod_osc->trie->root, path + 1, fmt, ptr);
+	}
+	else
+	{
+		lua_pushlightuserdata(L, mod_osc);
+		lua_rawget(L, LUA_REGISTRYINDEX);
+		if(!lua_isnil(L, -1))
+		{
+			int nargs;
+			if(mod_osc->view)
+			{
+				lua_rawgeti(L, LUA_REGISTRYINDEX, mod_osc->view_ref);
+				nargs = 1;
+			}
+			else
+			{
+				lua_pushnumber(L, mod_osc->time);
+				lua_pushstring(L, path);
+				lua_pushstring(L, fmt);
+				nargs = 3 + _push_args(L, fmt, ptr);
+			}
+
+			if(lua_pcall(L, nargs, 0, 0))
+			{
+				fprintf(stderr, "_message: %s\n", lua_tostring(L, -1));
+				lua_pop(L, 1); // pop error string
+			}
+		}
+		else
+			lua_pop(L, 1);
+	}
+
+	_expire();
+}
+
+// get pooled message view for next message of frame
+static mod_view_t *
+_frame_view(mod_osc_t *mod_osc)
+{
+	lua_State *L = mod_osc->L;
+
+	if(mod_osc->nframe == mod_osc->frame_size)
+	{
+		mod_view_t **frame = realloc(mod_osc->frame,
+			(mod_osc->frame_size + 1) * sizeof(mod_view_t *));
+		if(!frame)
+			return NULL;
+		mod_osc->frame = frame;
+
+		mod_view_t *view = lua_newuserdata(L, sizeof(mod_view_t));
+		memset(view, 0, sizeof(mod_view_t));
+		luaL_getmetatable(L, "mod_view_t");
+		lua_setmetatable(L, -2);
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mod_osc->frame_pool_ref);
+		lua_insert(L, -2);
+		lua_rawseti(L, -2, mod_osc->frame_size + 1);
+		lua_pop(L, 1); // pool
+
+		mod_osc->frame[mod_osc->frame_size++] = view;
+	}
+
+	return mod_osc->frame[mod_osc->nframe++];
+}
+
+// collect messages of bundle and its nested bundles in order of appearance
+static int
+_frame_collect(mod_osc_t *mod_osc, const osc_data_t *buf, size_t size,
+	unsigned depth)
+{
+	if( (depth >= FRAME_DEPTH) || (size < 16) || strncmp((const char *)buf, "#bundle", 8) )
+		return 0;
+
+	const osc_data_t *end = buf + size;
+	const osc_data_t *ptr = buf + 16; // skip bundle header
+	const osc_time_t time = be64toh(*(const uint64_t *)(buf + 8));
+
+	if(depth == 0)
+		mod_osc->time = time;
+
+	while(ptr < end)
+	{
+		const int32_t hsize = be32toh(*(const int32_t *)ptr);
+		ptr += sizeof(int32_t);
+
+		if( (hsize <= 0) || (hsize > end - ptr) )
+			return 0;
+
+		switch(*(const char *)ptr)
+		{
+			case '#':
+				if(!_frame_collect(mod_osc, ptr, hsize, depth + 1))
+					return 0;
+				break;
+			case '/':
+			{
+				const char *path = NULL;
+				const char *fmt = NULL;
+				const osc_data_t *args = osc_get_fmt(osc_get_path(ptr, &path), &fmt);
+
+				mod_view_t *view = _frame_view(mod_osc);
+				if(!view)
+					return 0;
+				_view_bind(view, time, path, fmt + 1, args);
+				break;
+			}
+			default:
+				return 0;
+		}
+
+		ptr += hsize;
+	}
+
+	return 1;
+}
+
+// deliver whole bundle as one frame of message views
+static int
+_frame_dispatch(mod_osc_t *mod_osc, const osc_data_t *buf, size_t size)
+{
+	lua_State *L = mod_osc->L;
+	int ret = 0;
+
+	mod_osc->nframe = 0;
+	if(_frame_collect(mod_osc, buf, size, 0))
+	{
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mod_osc->frame_ref);
+		lua_pushlightuserdata(L, mod_osc);
+		lua_rawget(L, LUA_REGISTRYINDEX); // responder
+		lua_pushnumber(L, mod_osc->time);
+
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mod_osc->frame_views_ref);
+		lua_rawgeti(L, LUA_REGISTRYINDEX, mod_osc->frame_pool_ref);
+		for(unsigned i=0; i<mod_osc->nframe; i++)
+		{
+			lua_rawgeti(L, -1, i + 1);
+			lua_rawseti(L, -3, i + 1);
+		}
+		lua_pop(L, 1); // pool
+		for(lua_Integer k = mod_osc->nframe + 1; lua_rawgeti(L, -1, k) != LUA_TNIL; k++)
+		{
+			lua_pop(L, 1);
+			lua_pushnil(L);
+			lua_rawseti(L, -2, k);
+		}
+		lua_pop(L, 1); // nil
+
+		if(lua_pcall(L, 3, 0, 0))
+		{
+			fprintf(stderr, "_frame_dispatch: %s\n", lua_tostring(L, -1));
+			lua_pop(L, 1); // pop error string
+		}
+
+		ret = 1;
+	}
+
+	mod_osc->nframe = 0;
+	_expire();
+
+	return ret;
+}
+
+static const osc_unroll_inject_t inject = {
+	.stamp = _stamp,
+	.message = _message,
+	.bundle = NULL
+};
+
+static void *
+_data_recv_req(size_t size, void *data)
+{
+	mod_osc_t *mod_osc = data;
+
+	return varchunk_write_request(mod_osc->from_net, size);
+}
+
+static void
+_data_recv_adv(size_t written, void *data)
+{
+	mod_osc_t *mod_osc = data;
+
+	varchunk_write_advance(mod_osc->from_net, written);
+
+	const osc_data_t *ptr;
+	size_t size;
+	mod_osc->dispatching = 1;
+	while(mod_osc->stream && (ptr = varchunk_read_request(mod_osc->from_net, &size)))
+	{
+		if( (mod_osc->frame_ref != LUA_NOREF) && mod_osc->L && (*(const char *)ptr == '#') )
+		{
+			if(!_frame_dispatch(mod_osc, ptr, size))
+				fprintf(stderr, "invalid OSC bundle\n");
+		}
+		else if(!osc_unroll_packet((osc_data_t *)ptr, size, OSC_UNROLL_MODE_FULL, (osc_unroll_inject_t *)&inject, mod_osc))
+			fprintf(stderr, "invalid OSC packet\n");
+
+		varchunk_read_advance(mod_osc->from_net);		
+	}
+	mod_osc->dispatching = 0;
+
+	if(!mod_osc->stream && mod_osc->from_net) // closed by a handler
+	{
+		varchunk_free(mod_osc->from_net);
+		mod_osc->from_net = NULL;
+	}
+}
+
+static const void *
+_data_send_req(size_t *len, void *data)
+{
+	mod_osc_t *mod_osc = data;
+
+	return varchunk_read_request(mod_osc->to_net, len);
+}
+
+static void
+_data_send_adv(void *data)
+{
+	mod_osc_t *mod_osc = data;
+
+	varchunk_read_advance(mod_osc->to_net);
+}
+
+static void
+_data_free(void *data)
+{
+	mod_osc_t *mod_osc = data;
+
+	mod_osc->stream = NULL;
+}
+
+static const osc_stream_driver_t driver = {
+	.recv_req = _data_recv_req,
+	.recv_adv = _data_recv_adv,
+	.send_req = _data_send_req,
+	.send_adv = _data_send_adv,
+	.free = _data_free
+};
+
+static int
+_new(lua_State *L)
+{
+	app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+	const char *url = luaL_checkstring(L, 1);
+
+	osc_trie_t *trie = luaL_testudata(L, 3, "osc_trie_t");
+	const int lazy = lua_toboolean(L, 4);
+	const int frame = !lua_isnoneornil(L, 5);
+	if(frame)
+		luaL_checktype(L, 5, LUA_TFUNCTION);
+
+	mod_osc_t *mod_osc = lua_newuserdata(L, sizeof(mod_osc_t));
+	if(!mod_osc)
+		goto fail;
+	memset(mod_osc, 0, sizeof(mod_osc_t));
+	mod_osc->L = L;
+	mod_osc->trie_ref = LUA_NOREF;
+	mod_osc->view_ref = LUA_NOREF;
+	mod_osc->frame_ref = LUA_NOREF;
+	mod_osc->frame_pool_ref = LUA_NOREF;
+	mod_osc->frame_views_ref = LUA_NOREF;
+	
+	if(!(mod_osc->from_net = varchunk_new(BUF_SIZE, false) ))
+		goto fail;
+	if(!(mod_osc->to_net = varchunk_new(BUF_SIZE, false)))
+		goto fail;
+	if(!(mod_osc->stream = osc_stream_new(app->loop, url, &driver, mod_osc)))
+		goto fail;
+
+	luaL_getmetatable(L, "mod_osc_t");
+	lua_setmetatable(L, -2);
+
+	lua_pushlightuserdata(L, mod_osc);
+	lua_pushvalue(L, 2); // push callback
+	lua_rawset(L, LUA_REGISTRYINDEX);
+
+	if(trie)
+	{
+		lua_pushvalue(L, 3);
+		mod_osc->trie_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		mod_osc->trie = trie;
+	}
+
+	if(lazy)
+	{
+		mod_view_t *view = lua_newuserdata(L, sizeof(mod_view_t));
+		memset(view, 0, sizeof(mod_view_t));
+		luaL_getmetatable(L, "mod_view_t");
+		lua_setmetatable(L, -2);
+		mod_osc->view_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		mod_osc->view = view;
+	}
+
+	if(frame)
+	{
+		lua_pushvalue(L, 5);
+		mod_osc->frame_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		mod_osc->frame_pool_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		lua_newtable(L);
+		mod_osc->frame_views_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+	}
+
+	return 1;
+
+fail:
+	lua_pushnil(L);
+	return 1;
+}
+
+static int
+_blob(lua_State *L)
+{
+	int size = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, size >= 0, 1, "negative size");
+	mod_blob_t *tb = _blob_alloc(L, size);
+	memset(tb->buf, 0, size);
+
+	return 1;
+}
+
+// get payload of owned or borrowed blob
+static const uint8_t *
+_blob_data(lua_State *L, int idx, int32_t *size)
+{
+	mod_borrow_t *bb = luaL_testudata(L, idx, "mod_borrow_t");
+	if(bb)
+	{
+		const uint8_t *buf = mod_borrow_data(bb);
+		if(!buf)
+			luaL_error(L, "borrowed blob used outside of its callback");
+		*size = bb->size;
+		return buf;
+	}
+
+	mod_blob_t *tb = luaL_checkudata(L, idx, "mod_blob_t");
+	*size = tb->size;
+	return tb->buf;
+}
+
+#define DUMP_CHUNK 256
+
+// convert big-endian 16-bit sensor values, values above 0x800 are negative
+static void
+_dump_decode(const uint8_t *src, int32_t *dst, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i thresh = _mm_set1_epi32(0x800);
+	const __m128i bias = _mm_set1_epi32(0xffff);
+
+	for( ; i + 8 <= n; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + 2*i));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+		__m128i lo = _mm_unpacklo_epi16(v, zero);
+		__m128i hi = _mm_unpackhi_epi16(v, zero);
+		lo = _mm_sub_epi32(lo, _mm_and_si128(_mm_cmpgt_epi32(lo, thresh), bias));
+		hi = _mm_sub_epi32(hi, _mm_and_si128(_mm_cmpgt_epi32(hi, thresh), bias));
+
+		_mm_storeu_si128((__m128i *)(dst + i), lo);
+		_mm_storeu_si128((__m128i *)(dst + i + 4), hi);
+	}
+#elif defined(__ARM_NEON)
+	const int32x4_t thresh = vdupq_n_s32(0x800);
+	const int32x4_t bias = vdupq_n_s32(0xffff);
+
+	for( ; i + 8 <= n; i += 8)
+	{
+		const uint16x8_t v = vreinterpretq_u16_u8(vrev16q_u8(vld1q_u8(src + 2*i)));
+
+		int32x4_t lo = vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(v)));
+		int32x4_t hi = vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(v)));
+		lo = vsubq_s32(lo, vandq_s32(vreinterpretq_s32_u32(vcgtq_s32(lo, thresh)), bias));
+		hi = vsubq_s32(hi, vandq_s32(vreinterpretq_s32_u32(vcgtq_s32(hi, thresh)), bias));
+
+		vst1q_s32(dst + i, lo);
+		vst1q_s32(dst + i + 4, hi);
+	}
+#endif
+
+	for( ; i < n; i++)
+	{
+		const int32_t v = (src[2*i] << 8) | src[2*i + 1];
+		dst[i] = v > 0x800 ? v - 0xffff : v;
+	}
+}
+
+static char *
+_dump_itoa(char *ptr, int32_t v)
+{
+	char tmp [12];
+	char *end = tmp + sizeof(tmp);
+	char *pos = end;
+	uint32_t u = v < 0 ? -(uint32_t)v : (uint32_t)v;
+
+	do {
+		*--pos = '0' + u % 10;
+		u /= 10;
+	} while(u);
+	if(v < 0)
+		*--pos = '-';
+
+	memcpy(ptr, pos, end - pos);
+	return ptr + (end - pos);
+}
+
+// decode sensor dump blob into (reused) table or JSON array string
+static int
+_decode_dump(lua_State *L)
+{
+	int32_t size;
+	const uint8_t *src = _blob_data(L, 1, &size);
+	const size_t n = size / 2;
+	int32_t tmp [DUMP_CHUNK];
+
+	if(lua_type(L, 2) == LUA_TSTRING)
+	{
+		luaL_argcheck(L, !strcmp(lua_tostring(L, 2), "json"), 2, "unknown format");
+
+		luaL_Buffer b;
+		luaL_buffinit(L, &b);
+		luaL_addchar(&b, '[');
+		for(size_t i=0; i<n; i+=DUMP_CHUNK)
+		{
+			const size_t m = (n - i) < DUMP_CHUNK ? (n - i) : DUMP_CHUNK;
+			_dump_decode(src + 2*i, tmp, m);
+
+			char *buf = luaL_prepbuffsize(&b, m*12);
+			char *ptr = buf;
+			for(size_t j=0; j<m; j++)
+			{
+				if(i + j)
+					*ptr++ = ',';
+				ptr = _dump_itoa(ptr, tmp[j]);
+			}
+			luaL_addsize(&b, ptr - buf);
+		}
+		luaL_addchar(&b, ']');
+		luaL_pushresult(&b);
+
+		return 1;
+	}
+
+	if(lua_istable(L, 2))
+	{
+		lua_settop(L, 2);
+		for(lua_Integer k = n + 1; lua_rawgeti(L, 2, k) != LUA_TNIL; k++)
+		{
+			lua_pop(L, 1);
+			lua_pushnil(L);
+			lua_rawseti(L, 2, k);
+		}
+		lua_pop(L, 1);
+	}
+	else
+	{
+		lua_settop(L, 1);
+		lua_createtable(L, n, 0);
+	}
+
+	for(size_t i=0; i<n; i+=DUMP_CHUNK)
+	{
+		const size_t m = (n - i) < DUMP_CHUNK ? (n - i) : DUMP_CHUNK;
+		_dump_decode(src + 2*i, tmp, m);
+
+		for(size_t j=0; j<m; j++)
+		{
+			lua_pushinteger(L, tmp[j]);
+			lua_rawseti(L, 2, i + j + 1);
+		}
+	}
+
+	return 1;
+}
+
+static osc_node_t *
+_node_child(osc_node_t *node, const char *name, size_t len)
+{
+	for(unsigned i=0; i<node->nchildren; i++)
+	{
+		osc_node_t *child = &node->children[i];
+		if(!strncmp(child->name, name, len) && !child->name[len])
+			return child;
+	}
+
+	osc_node_t *children = realloc(node->children, (node->nchildren + 1) * sizeof(osc_node_t));
+	if(!children)
+		return NULL;
+	node->children = children;
+
+	osc_node_t *child = &node->children[node->nchildren];
+	memset(child, 0, sizeof(osc_node_t));
+	if(!(child->name = strndup(name, len)))
+		return NULL;
+	node->nchildren++;
+
+	return child;
+}
+
+static void
+_node_free(lua_State *L, osc_node_t *node)
+{
+	for(unsigned i=0; i<node->nchildren; i++)
+		_node_free(L, &node->children[i]);
+	free(node->children);
+
+	for(unsigned i=0; i<node->nhandlers; i++)
+	{
+		free(node->handlers[i].fmt);
+		luaL_unref(L, LUA_REGISTRYINDEX, node->handlers[i].ref);
+	}
+	free(node->handlers);
+
+	free(node->name);
+	memset(node, 0, sizeof(osc_node_t));
+}
+
+// compile nested method table, keys are path segments optionally followed by
+// a type tag as in 'dump,ib', values are handlers or tables of sub-methods
+static int
+_node_compile(lua_State *L, int idx, osc_node_t *node, int depth)
+{
+	if(depth > 32)
+		return luaL_error(L, "method tree too deep");
+
+	luaL_checkstack(L, 3, "method tree too deep");
+
+	lua_pushnil(L);
+	while(lua_next(L, idx))
+	{
+		if(lua_type(L, -2) != LUA_TSTRING)
+			return luaL_error(L, "method name must be a string");
+
+		const char *key = lua_tostring(L, -2);
+		const char *comma = strchr(key, ',');
+		const size_t len = comma ? (size_t)(comma - key) : strlen(key);
+
+		if(!len || memchr(key, '/', len) || strpbrk(key, "*?[]{} #"))
+			return luaL_error(L, "invalid method name '%s'", key);
+
+		osc_node_t *child = _node_child(node, key, len);
+		if(!child)
+			return luaL_error(L, "out of memory");
+
+		if(lua_isfunction(L, -1))
+		{
+			osc_handler_t *handlers = realloc(child->handlers,
+				(child->nhandlers + 1) * sizeof(osc_handler_t));
+			if(!handlers)
+				return luaL_error(L, "out of memory");
+			child->handlers = handlers;
+
+			osc_handler_t *handler = &child->handlers[child->nhandlers++];
+			handler->fmt = comma ? strdup(comma + 1) : NULL;
+			lua_pushvalue(L, -1);
+			handler->ref = luaL_ref(L, LUA_REGISTRYINDEX);
+		}
+		else if(lua_istable(L, -1) && !comma)
+			_node_compile(L, lua_gettop(L), child, depth + 1);
+		else
+			return luaL_error(L, "invalid method '%s'", key);
+
+		lua_pop(L, 1);
+	}
+
+	// sort for binary search of literal segments
+	qsort(node->children, node->nchildren, sizeof(osc_node_t), _node_cmp);
+
+	return 0;
+}
+
+static int
+_trie(lua_State *L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	osc_trie_t *trie = lua_newuserdata(L, sizeof(osc_trie_t));
+	memset(trie, 0, sizeof(osc_trie_t));
+	trie->L = L;
+
+	luaL_getmetatable(L, "osc_trie_t");
+	lua_setmetatable(L, -2);
+
+	_node_compile(L, 1, &trie->root, 0);
+
+	return 1;
+}
+
+static int
+_trie_gc(lua_State *L)
+{
+	osc_trie_t *trie = luaL_checkudata(L, 1, "osc_trie_t");
+
+	_node_free(L, &trie->root);
+
+	return 0;
+}
+
+static const luaL_Reg losc [] = {
+	{"new", _new},
+	{"trie", _trie},
+	{"blob", _blob},
+	{"decode_dump", _decode_dump},
+	{NULL, NULL}
+};
+
+static int
+_blob_index(lua_State *L)
+{
+	mod_blob_t *tb = luaL_checkudata(L, 1, "mod_blob_t");
+
+	int typ = lua_type(L, 2);
+	if(typ == LUA_TNUMBER)
+	{
+		int index = luaL_checkinteger(L, 2);
+		if( (index >= 0) && (index < tb->size) )
+			lua_pushnumber(L, tb->buf[index]);
+		else
+			lua_pushnil(L);
+	}
+	else if( (typ == LUA_TSTRING) && !strcmp(lua_tostring(L, 2), "raw") )
+		lua_pushlightuserdata(L, tb->buf);
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+_blob_newindex(lua_State *L)
+{
+	mod_blob_t *tb = luaL_checkudata(L, 1, "mod_blob_t");
+	int index = luaL_checkinteger(L, 2);
+
+	if( (index >= 0) && (index < tb->size) )
+		tb->buf[index] = luaL_checkinteger(L, 3);
+
+	return 0;
+}
+
+static int
+_blob_len(lua_State *L)
+{
+	mod_blob_t *tb = luaL_checkudata(L, 1, "mod_blob_t");
+
+	lua_pushnumber(L, tb->size);
+
+	return 1;
+}
+
+// recycle collected blob into pool, setting the metatable again resurrects it
+// for another round of finalization
+static int
+_blob_gc(lua_State *L)
+{
+	mod_blob_t *tb = luaL_checkudata(L, 1, "mod_blob_t");
+
+	if( (tb->size > POOL_SIZE_MAX) || (pool_bytes + tb->size > POOL_BYTES_MAX) )
+		return 0;
+
+	lua_pushlightuserdata(L, &blob_pool);
+	lua_rawget(L, LUA_REGISTRYINDEX);
+	if(lua_rawgeti(L, -1, tb->size) != LUA_TTABLE)
+	{
+		lua_pop(L, 1);
+		lua_createtable(L, POOL_MAX, 0);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, -3, tb->size);
+	}
+
+	const lua_Integer n = luaL_len(L, -1);
+	if(n < POOL_MAX)
+	{
+		luaL_getmetatable(L, "mod_blob_t");
+		lua_setmetatable(L, 1);
+		lua_pushvalue(L, 1);
+		lua_rawseti(L, -2, n + 1);
+		pool_bytes += tb->size;
+	}
+	lua_pop(L, 2); // pool, list
+
+	return 0;
 }
 
 static const luaL_Reg lblob [] = {
 	{"__index", _blob_index},
 	{"__newindex", _blob_newindex},
 	{"__len", _blob_len},
+	{"__gc", _blob_gc},
+	{NULL, NULL}
+};
+
+static mod_borrow_t *
+_borrow_check(lua_State *L)
+{
+	mod_borrow_t *bb = luaL_checkudata(L, 1, "mod_borrow_t");
+
+	if(!mod_borrow_data(bb))
+		luaL_error(L, "borrowed blob used outside of its callback");
+
+	return bb;
+}
+
+// copy borrowed blob to keep it, into dst if given and of same size
+static int
+_borrow_copy(lua_State *L)
+{
+	mod_borrow_t *bb = _borrow_check(L);
+	mod_blob_t *tb = luaL_testudata(L, 2, "mod_blob_t");
+
+	if(tb && (tb->size == bb->size) )
+		lua_pushvalue(L, 2);
+	else
+		tb = _blob_alloc(L, bb->size);
+	memcpy(tb->buf, bb->buf, bb->size);
+
+	return 1;
+}
+
+static int
+_borrow_index(lua_State *L)
+{
+	mod_borrow_t *bb = _borrow_check(L);
+
+	int typ = lua_type(L, 2);
+	if(typ == LUA_TNUMBER)
+	{
+		int index = luaL_checkinteger(L, 2);
+		if( (index >= 0) && (index < bb->size) )
+			lua_pushinteger(L, bb->buf[index]);
+		else
+			lua_pushnil(L);
+	}
+	else if(typ == LUA_TSTRING)
+	{
+		const char *key = lua_tostring(L, 2);
+		if(!strcmp(key, "raw"))
+			lua_pushlightuserdata(L, (void *)bb->buf);
+		else if(!strcmp(key, "copy"))
+			lua_pushcfunction(L, _borrow_copy);
+		else
+			lua_pushnil(L);
+	}
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+_borrow_len(lua_State *L)
+{
+	mod_borrow_t *bb = _borrow_check(L);
+
+	lua_pushnumber(L, bb->size);
+
+	return 1;
+}
+
+static int
+_borrow_tostring(lua_State *L)
+{
+	mod_borrow_t *bb = luaL_checkudata(L, 1, "mod_borrow_t");
+
+	if(mod_borrow_data(bb))
+		lua_pushfstring(L, "mod_borrow_t: %d bytes", (int)bb->size);
+	else
+		lua_pushstring(L, "mod_borrow_t: expired");
+
+	return 1;
+}
+
+static const luaL_Reg lborrow [] = {
+	{"__index", _borrow_index},
+	{"__len", _borrow_len},
+	{"__tostring", _borrow_tostring},
+	{NULL, NULL}
+};
+
+static mod_view_t *
+_view_check(lua_State *L)
+{
+	mod_view_t *view = luaL_checkudata(L, 1, "mod_view_t");
+
+	if(!view->fmt || (view->gen != mod_osc_gen) )
+		luaL_error(L, "message view used outside of its callback");
+
+	return view;
+}
+
+// look up argument by 1-based index, type tag is returned or 0 if out of range
+static char
+_view_lookup(mod_view_t *view, int idx, const osc_data_t **ptr)
+{
+	if( (idx < 1) || ((unsigned)idx > view->nargs) )
+		return 0;
+
+	if(!(*ptr = _view_arg(view, idx - 1)))
+		return 0;
+
+	return view->fmt[idx - 1];
+}
+
+static int
+_view_index(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+
+	if(lua_type(L, 2) == LUA_TNUMBER)
+	{
+		const osc_data_t *ptr;
+		const char type = _view_lookup(view, luaL_checkinteger(L, 2), &ptr);
+
+		if(!type || !_push_arg(L, type, ptr))
+			lua_pushnil(L);
+	}
+	else
+	{
+		lua_getmetatable(L, 1);
+		lua_pushvalue(L, 2);
+		lua_rawget(L, -2);
+	}
+
+	return 1;
+}
+
+static int
+_view_len(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+
+	lua_pushinteger(L, view->nargs);
+
+	return 1;
+}
+
+static int
+_view_path(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+
+	lua_pushstring(L, view->path);
+
+	return 1;
+}
+
+static int
+_view_format(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+
+	lua_pushstring(L, view->fmt);
+
+	return 1;
+}
+
+static int
+_view_time(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+
+	lua_pushnumber(L, view->time);
+
+	return 1;
+}
+
+static int
+_view_type(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+	const int idx = luaL_checkinteger(L, 2);
+
+	if( (idx >= 1) && ((unsigned)idx <= view->nargs) )
+		lua_pushlstring(L, &view->fmt[idx - 1], 1);
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+static int
+_view_number(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+	const int idx = luaL_checkinteger(L, 2);
+	const osc_data_t *ptr;
+
+	switch(_view_lookup(view, idx, &ptr))
+	{
+		case OSC_INT32:
+		case OSC_FLOAT:
+		case OSC_INT64:
+		case OSC_DOUBLE:
+		case OSC_TIMETAG:
+		case OSC_CHAR:
+			_push_arg(L, view->fmt[idx - 1], ptr);
+			return 1;
+	}
+
+	return luaL_argerror(L, 2, "not a numeric argument");
+}
+
+static int
+_view_string(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+	const int idx = luaL_checkinteger(L, 2);
+	const osc_data_t *ptr;
+
+	switch(_view_lookup(view, idx, &ptr))
+	{
+		case OSC_STRING:
+		case OSC_SYMBOL:
+			_push_arg(L, view->fmt[idx - 1], ptr);
+			return 1;
+	}
+
+	return luaL_argerror(L, 2, "not a string argument");
+}
+
+static int
+_view_blob(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+	const int idx = luaL_checkinteger(L, 2);
+	const osc_data_t *ptr;
+
+	if(_view_lookup(view, idx, &ptr) != OSC_BLOB)
+		return luaL_argerror(L, 2, "not a blob argument");
+
+	_push_arg(L, OSC_BLOB, ptr);
+
+	return 1;
+}
+
+static int
+_view_midi(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+	const int idx = luaL_checkinteger(L, 2);
+	const osc_data_t *ptr;
+	const uint8_t *m;
+
+	if( (_view_lookup(view, idx, &ptr) != OSC_MIDI) || !osc_get_midi(ptr, &m) )
+		return luaL_argerror(L, 2, "not a MIDI argument");
+
+	for(int i=0; i<4; i++)
+		lua_pushinteger(L, m[i]);
+
+	return 4;
+}
+
+static int
+_view_unpack(lua_State *L)
+{
+	mod_view_t *view = _view_check(L);
+
+	return _push_args(L, view->fmt, view->args[0]);
+}
+
+static int
+_view_tostring(lua_State *L)
+{
+	mod_view_t *view = luaL_checkudata(L, 1, "mod_view_t");
+
+	if(view->fmt && (view->gen == mod_osc_gen) )
+		lua_pushfstring(L, "mod_view_t: %s ,%s", view->path, view->fmt);
+	else
+		lua_pushstring(L, "mod_view_t: expired");
+
+	return 1;
+}
+
+static const luaL_Reg lview [] = {
+	{"__index", _view_index},
+	{"__len", _view_len},
+	{"__tostring", _view_tostring},
+	{"path", _view_path},
+	{"format", _view_format},
+	{"time", _view_time},
+	{"type", _view_type},
+	{"number", _view_number},
+	{"string", _view_string},
+	{"blob", _view_blob},
+	{"midi", _view_midi},
+	{"unpack", _view_unpack},
 	{NULL, NULL}
 };
 
@@ -449,6 +1648,23 @@ luaopen_osc(app_t *app)
 	luaL_setfuncs(L, lmt, 1);
 	lua_pop(L, 1);
 	
+	luaL_newmetatable(L, "osc_trie_t");
+	lua_pushcfunction(L, _trie_gc);
+	lua_setfield(L, -2, "__gc");
+	lua_pop(L, 1);
+
+	luaL_newmetatable(L, "mod_view_t");
+	luaL_setfuncs(L, lview, 0);
+	lua_pop(L, 1);
+
+	luaL_newmetatable(L, "mod_borrow_t");
+	luaL_setfuncs(L, lborrow, 0);
+	lua_pop(L, 1);
+
+	lua_pushlightuserdata(L, &blob_pool);
+	lua_newtable(L);
+	lua_rawset(L, LUA_REGISTRYINDEX);
+
 	luaL_newmetatable(L, "mod_blob_t");
 	lua_pushvalue(L, -1);
 	lua_setfield(L, -2, "__index");
@@ -17,47 +17,861 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
 
 #include <chimaerad.h>
 
 #include <lua.h>
 #include <lauxlib.h>
 
-uint8_t *
-zip_read(app_t *app, const char *key, size_t *size)
+#include <inlist.h>
+
+#if !defined(__WINDOWS__)
+#	include <fcntl.h>
+#	include <unistd.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#endif
+
+#define CACHE_BUCKETS 256 // must be a power of two
+#define CACHE_MAX 0x400000 // default memory budget of cached entries
+#define INDEX_MIN 16 // min slots of index table, must be a power of two
+
+typedef struct _entry_t entry_t;
+typedef struct _job_t job_t;
+typedef struct _mime_t mime_t;
+typedef struct _map_t map_t;
+typedef struct _zip_blob_t zip_blob_t;
+
+struct _entry_t {
+	INLIST; // lru order, least recently used first
+	entry_t *next; // hash chain
+	uint32_t hash;
+	int refs;
+	int cached;
+	int gzip;
+	size_t size;
+	const char *key;
+	uint8_t data [];
+};
+
+struct _job_t {
+	INLIST; // pending jobs of cache
+	uv_work_t req;
+	app_t *app;
+	struct zip *io;
+	zip_cb_t cb;
+	void *data;
+	int gzip;
+	zip_info_t info; // copy, index may be rebuilt while job is pending
+	entry_t *entry;
+	int detached; // owner is gone, callback must not be invoked
+	char key [];
+};
+
+struct _mime_t {
+	const char *ext;
+	const char *type;
+};
+
+// read-only mapping of archive file, stored entries point into it
+struct _map_t {
+	INLIST;
+	uint8_t *base;
+	size_t size;
+	int refs;
+	int owned; // mapped by us, else archive linked into executable
+};
+
+// referenced entry data exposed to Lua without copying
+struct _zip_blob_t {
+	const uint8_t *data;
+	size_t size;
+};
+
+struct _zip_cache_t {
+	uv_mutex_t mutex; // serializes libzip access from loop and worker threads
+	struct zip *io; // archive entries were read from
+
+	// current mapping first, retired ones are kept until unreferenced
+	Inlist *maps;
+	map_t *map;
+
+	// open addressing table of archive entries, built once per archive
+	zip_info_t *entries;
+	size_t nentries;
+	uint32_t *slots; // position in entries + 1, 0 if empty
+	uint32_t mask;
+
+	entry_t *buckets [CACHE_BUCKETS];
+	Inlist *lru;
+	Inlist *jobs; // queued or running zip_acquire_async reads
+	size_t size;
+	size_t max;
+	unsigned hits;
+	unsigned misses;
+	unsigned mapped;
+};
+
+static const uint8_t gzip_header [10] = {
+	0x1f, 0x8b, // magic
+	0x08, // deflate
+	0x00, // flags
+	0x00, 0x00, 0x00, 0x00, // mtime
+	0x00, // extra flags
+	0xff // unknown os
+};
+
+static const mime_t mime_types [] = {
+	{"html", "text/html"},
+	{"css", "text/css"},
+	{"js", "text/javascript"},
+	{"json", "application/json"},
+	{"png", "image/png"},
+	{"ttf", "font/ttf"},
+	{"woff", "font/woff"},
+	{"woff2", "font/woff2"},
+	{NULL, "application/octet-stream"}
+};
+
+static uint32_t
+_hash(const char *key, int gzip)
 {
-	struct zip_stat stat;
-	if(!zip_stat(app->io, key, 0, &stat))
+	uint32_t hash = 0x811c9dc5; // fnv-1a
+
+	for(const char *c = key; *c; c++)
+		hash = (hash ^ (uint8_t)*c) * 0x01000193;
+
+	return gzip ? ~hash : hash;
+}
+
+static const char *
+_mime_type(const char *name)
+{
+	const char *dot = strrchr(name, '.');
+	const mime_t *mime;
+
+	for(mime = mime_types; mime->ext; mime++)
 	{
-		size_t fsize = stat.size;
-		struct zip_file *f = zip_fopen(app->io, key, 0);
-		if(f)
+		if(dot && !strcmp(dot + 1, mime->ext))
+			break;
+	}
+
+	return mime->type;
+}
+
+static void
+_map_free(zip_cache_t *cache, map_t *map)
+{
+	cache->maps = inlist_remove(cache->maps, INLIST_GET(map));
+	if(cache->map == map)
+		cache->map = NULL;
+
+#if !defined(__WINDOWS__)
+	if(map->owned)
+		munmap(map->base, map->size);
+#endif
+	free(map);
+}
+
+static map_t *
+_map_open(zip_cache_t *cache, app_t *app)
+{
+	map_t *map = NULL;
+
+	if(app->embed) // already resident, no need to map
+	{
+		map = calloc(1, sizeof(map_t));
+		if(map)
 		{
-			uint8_t *str = malloc(fsize);
-			if(str)
+			map->base = (uint8_t *)app->embed;
+			map->size = app->nembed;
+			cache->maps = inlist_prepend(cache->maps, INLIST_GET(map));
+			cache->map = map;
+		}
+
+		return map;
+	}
+
+#if !defined(__WINDOWS__)
+	struct stat st;
+	const char *path = app->bundle;
+
+	if(!path)
+		return NULL;
+
+	const int fd = open(path, O_RDONLY);
+	if(fd == -1)
+		return NULL;
+
+	if(!fstat(fd, &st) && (st.st_size > 0))
+	{
+		void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if(base != MAP_FAILED)
+		{
+			map = calloc(1, sizeof(map_t));
+			if(map)
 			{
-				if(zip_fread(f, str, fsize) == -1)
-				{
-					free(str);
-					str = NULL;
-					fsize = 0;
-				}
-				else
+				map->base = base;
+				map->size = st.st_size;
+				map->owned = 1;
+				cache->maps = inlist_prepend(cache->maps, INLIST_GET(map));
+				cache->map = map;
+			}
+			else
+				munmap(base, st.st_size);
+		}
+	}
+	close(fd);
+
+	return map;
+#else
+	return map; // no mmap, stored entries are read like deflated ones
+#endif
+}
+
+// retire current mapping, it is unmapped once no data points into it anymore
+static void
+_map_retire(zip_cache_t *cache)
+{
+	map_t *map = cache->map;
+
+	if(!map)
+		return;
+
+	cache->map = NULL;
+	if(!map->refs)
+		_map_free(cache, map);
+}
+
+// hand back data if it points into a mapping
+static int
+_map_release(zip_cache_t *cache, const uint8_t *data)
+{
+	Inlist *l;
+	map_t *map;
+
+	INLIST_FOREACH_SAFE(cache->maps, l, map)
+	{
+		if( (data >= map->base) && (data < map->base + map->size) )
+		{
+			if( (--map->refs == 0) && (map != cache->map) )
+				_map_free(cache, map);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static uint16_t
+_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t
+_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// locate data of stored entries in mapping via central directory,
+// libzip indices follow central directory order
+static void
+_index_map(zip_cache_t *cache)
+{
+	const map_t *map = cache->map;
+
+	if(!map || (map->size < 22))
+		return;
+
+	const uint8_t *base = map->base;
+	const size_t size = map->size;
+
+	// find end of central directory record, followed by comment of up to 64K
+	const uint8_t *eocd = NULL;
+	for(size_t pos = size - 22; ; pos--)
+	{
+		if(_le32(base + pos) == 0x06054b50)
+		{
+			eocd = base + pos;
+			break;
+		}
+
+		if( (pos == 0) || (size - pos >= 22 + 0xffff) )
+			break;
+	}
+	if(!eocd)
+		return;
+
+	const uint32_t count = _le16(eocd + 10);
+	const uint32_t cd_size = _le32(eocd + 12);
+	const uint32_t cd_offset = _le32(eocd + 16);
+	if( (cd_offset == 0xffffffff) || ((size_t)cd_offset + cd_size > size) ) // zip64
+		return;
+
+	const uint8_t *cd = base + cd_offset;
+	const uint8_t *cd_end = cd + cd_size;
+	size_t j = 0;
+
+	for(uint32_t i=0; (i<count) && (cd + 46 <= cd_end); i++)
+	{
+		if(_le32(cd) != 0x02014b50)
+			return;
+
+		const uint16_t flags = _le16(cd + 8);
+		const uint16_t method = _le16(cd + 10);
+		const uint32_t comp_size = _le32(cd + 20);
+		const uint16_t nname = _le16(cd + 28);
+		const uint16_t nextra = _le16(cd + 30);
+		const uint16_t ncomment = _le16(cd + 32);
+		const uint32_t lho = _le32(cd + 42);
+		const uint8_t *name = cd + 46;
+
+		cd += 46 + nname + nextra + ncomment;
+
+		while( (j < cache->nentries) && (cache->entries[j].index < i) )
+			j++;
+		if( (j == cache->nentries) || (cache->entries[j].index != i) )
+			continue;
+
+		zip_info_t *info = &cache->entries[j];
+
+		// empty entries are never mapped, their data would point past the mapping
+		if( (method != ZIP_CM_STORE) || (flags & 0x1) // encrypted
+			|| !comp_size || (comp_size != info->size) || (lho == 0xffffffff)
+			|| ((size_t)lho + 30 > size) || (_le32(base + lho) != 0x04034b50) )
+			continue;
+
+		if( (strlen(info->name) != nname) || memcmp(info->name, name, nname) )
+			continue;
+
+		const size_t offset = (size_t)lho + 30 + _le16(base + lho + 26) + _le16(base + lho + 28);
+		if(offset + comp_size > size)
+			continue;
+
+		info->mapped = base + offset;
+	}
+}
+
+static void
+_index_free(zip_cache_t *cache)
+{
+	for(size_t i=0; i<cache->nentries; i++)
+		free((char *)cache->entries[i].name);
+
+	free(cache->entries);
+	free(cache->slots);
+	cache->entries = NULL;
+	cache->nentries = 0;
+	cache->slots = NULL;
+	cache->mask = 0;
+}
+
+// enumerate archive once, directories are skipped
+static int
+_index_build(zip_cache_t *cache, struct zip *io)
+{
+	const zip_int64_t num = io ? zip_get_num_entries(io, 0) : 0;
+	if( (num <= 0) || (num >= UINT32_MAX / 2) )
+		return 0;
+
+	uint32_t nslots = INDEX_MIN;
+	while(nslots < 2*num) // keep load factor below 0.5
+		nslots <<= 1;
+
+	cache->entries = calloc(num, sizeof(zip_info_t));
+	cache->slots = calloc(nslots, sizeof(uint32_t));
+	if(!cache->entries || !cache->slots)
+	{
+		_index_free(cache);
+		return -1;
+	}
+	cache->mask = nslots - 1;
+
+	uv_mutex_lock(&cache->mutex);
+	for(zip_int64_t i=0; i<num; i++)
+	{
+		struct zip_stat stat;
+		if(zip_stat_index(io, i, 0, &stat) || !(stat.valid & ZIP_STAT_NAME))
+			continue;
+
+		const size_t len = strlen(stat.name);
+		if(!len || (stat.name[len - 1] == '/'))
+			continue;
+
+		char *name = strdup(stat.name);
+		if(!name)
+			continue;
+
+		zip_info_t *info = &cache->entries[cache->nentries];
+		info->name = name;
+		info->index = stat.index;
+		info->size = stat.size;
+		info->comp_size = stat.comp_size;
+		info->crc = stat.crc;
+		info->comp_method = stat.comp_method;
+		info->deflated = (stat.comp_method == ZIP_CM_DEFLATE)
+			&& (stat.encryption_method == ZIP_EM_NONE);
+		info->mime = _mime_type(name);
+
+		uint32_t slot = _hash(name, 0) & cache->mask;
+		while(cache->slots[slot])
+			slot = (slot + 1) & cache->mask;
+		cache->slots[slot] = ++cache->nentries;
+	}
+	uv_mutex_unlock(&cache->mutex);
+
+	_index_map(cache);
+
+	return 0;
+}
+
+static const zip_info_t *
+_index_lookup(zip_cache_t *cache, const char *key)
+{
+	if(!cache->slots)
+		return NULL;
+
+	for(uint32_t slot = _hash(key, 0) & cache->mask;
+		cache->slots[slot];
+		slot = (slot + 1) & cache->mask)
+	{
+		const zip_info_t *info = &cache->entries[cache->slots[slot] - 1];
+
+		if(!strcmp(info->name, key))
+			return info;
+	}
+
+	return NULL;
+}
+
+// read entry, either inflated or as raw deflate stream wrapped into a gzip member,
+// safe to be called from worker threads
+static entry_t *
+_entry_read(zip_cache_t *cache, struct zip *io, const zip_info_t *info,
+	const char *key, int gzip)
+{
+	entry_t *entry = NULL;
+
+	size_t fsize = info->size;
+	if(gzip)
+	{
+		if(!info->deflated || (info->size > UINT32_MAX) )
+			return NULL;
+
+		fsize = sizeof(gzip_header) + info->comp_size + 8;
+	}
+
+	uv_mutex_lock(&cache->mutex);
+
+	struct zip_file *f = zip_fopen_index(io, info->index, gzip ? ZIP_FL_COMPRESSED : 0);
+	if(!f)
+		goto unlock;
+
+	const size_t nkey = strlen(key) + 1;
+	entry = malloc(sizeof(entry_t) + fsize + nkey);
+	if(entry)
+	{
+		uint8_t *dst = entry->data;
+		const size_t nread = gzip ? info->comp_size : fsize;
+
+		if(gzip)
+			dst += sizeof(gzip_header);
+
+		if(zip_fread(f, dst, nread) != (zip_int64_t)nread)
+		{
+			free(entry);
+			entry = NULL;
+		}
+		else
+		{
+			if(gzip)
+			{
+				uint8_t *trailer = dst + nread;
+				const uint32_t crc = info->crc;
+				const uint32_t isize = info->size;
+
+				memcpy(entry->data, gzip_header, sizeof(gzip_header));
+				for(unsigned i=0; i<4; i++)
 				{
-					; //success
+					trailer[i] = crc >> (i*8);
+					trailer[4 + i] = isize >> (i*8);
 				}
 			}
-			zip_fclose(f);
 
-			*size = fsize;
-			return str;
+			char *dup = (char *)entry->data + fsize;
+			memcpy(dup, key, nkey);
+
+			entry->next = NULL;
+			entry->hash = _hash(key, gzip);
+			entry->refs = 0;
+			entry->cached = 0;
+			entry->gzip = gzip;
+			entry->size = fsize;
+			entry->key = dup;
+		}
+	}
+	zip_fclose(f);
+
+unlock:
+	uv_mutex_unlock(&cache->mutex);
+
+	return entry;
+}
+
+static void
+_cache_unlink(zip_cache_t *cache, entry_t *entry)
+{
+	entry_t **ptr = &cache->buckets[entry->hash & (CACHE_BUCKETS - 1)];
+
+	while(*ptr != entry)
+		ptr = &(*ptr)->next;
+	*ptr = entry->next;
+
+	cache->lru = inlist_remove(cache->lru, INLIST_GET(entry));
+	cache->size -= entry->size;
+	entry->cached = 0;
+
+	if(!entry->refs)
+		free(entry);
+}
+
+// evict unreferenced entries in lru order until size fits into budget
+static void
+_cache_evict(zip_cache_t *cache, size_t size)
+{
+	Inlist *l;
+	entry_t *entry;
+
+	INLIST_FOREACH_SAFE(cache->lru, l, entry)
+	{
+		if(cache->size + size <= cache->max)
+			break;
+
+		if(!entry->refs)
+			_cache_unlink(cache, entry);
+	}
+}
+
+// drop all entries, referenced ones are freed on their release
+static void
+_cache_flush(zip_cache_t *cache)
+{
+	Inlist *l;
+	entry_t *entry;
+
+	INLIST_FOREACH_SAFE(cache->lru, l, entry)
+		_cache_unlink(cache, entry);
+}
+
+static zip_cache_t *
+_cache(app_t *app)
+{
+	zip_cache_t *cache = app->cache;
+
+	if(!cache)
+	{
+		cache = calloc(1, sizeof(zip_cache_t));
+		if(!cache)
+			return NULL;
+
+		if(uv_mutex_init(&cache->mutex))
+		{
+			free(cache);
+			return NULL;
+		}
+
+		cache->max = CACHE_MAX;
+		cache->io = app->io;
+		app->cache = cache;
+
+		_map_open(cache, app);
+		if(_index_build(cache, cache->io))
+			fprintf(stderr, "_index_build: out of memory\n");
+	}
+	else if(cache->io != app->io) // bundle has been reopened
+	{
+		_cache_flush(cache);
+		_index_free(cache);
+		_map_retire(cache);
+		cache->io = app->io;
+
+		_map_open(cache, app);
+		if(_index_build(cache, cache->io))
+			fprintf(stderr, "_index_build: out of memory\n");
+	}
+
+	return cache;
+}
+
+// look up and reference cached entry
+static entry_t *
+_cache_lookup(zip_cache_t *cache, const char *key, int gzip)
+{
+	const uint32_t hash = _hash(key, gzip);
+	entry_t *entry;
+
+	for(entry = cache->buckets[hash & (CACHE_BUCKETS - 1)]; entry; entry = entry->next)
+	{
+		if( (entry->hash == hash) && (entry->gzip == gzip) && !strcmp(entry->key, key) )
+		{
+			cache->lru = inlist_remove(cache->lru, INLIST_GET(entry));
+			cache->lru = inlist_append(cache->lru, INLIST_GET(entry));
+
+			entry->refs += 1;
+			return entry;
 		}
 	}
 
-	*size = 0;
 	return NULL;
 }
 
+// reference freshly read entry and cache it if it fits into budget
+static void
+_cache_insert(zip_cache_t *cache, entry_t *entry)
+{
+	entry->refs = 1;
+
+	_cache_evict(cache, entry->size);
+	if(cache->size + entry->size <= cache->max)
+	{
+		entry_t **bucket = &cache->buckets[entry->hash & (CACHE_BUCKETS - 1)];
+
+		entry->next = *bucket;
+		*bucket = entry;
+		cache->lru = inlist_append(cache->lru, INLIST_GET(entry));
+		cache->size += entry->size;
+		entry->cached = 1;
+	}
+}
+
+// get refcounted entry data, must be handed back with zip_release
+const uint8_t *
+zip_acquire(app_t *app, const char *key, size_t *size, int gzip)
+{
+	zip_cache_t *cache;
+	entry_t *entry;
+
+	*size = 0;
+
+	if(!app->io || !(cache = _cache(app)))
+		return NULL;
+
+	const zip_info_t *info = _index_lookup(cache, key);
+	if(!info)
+		return NULL;
+
+	if(!gzip && info->mapped)
+	{
+		cache->map->refs += 1;
+		cache->mapped += 1;
+		*size = info->size;
+		return info->mapped;
+	}
+
+	if((entry = _cache_lookup(cache, key, gzip)))
+	{
+		cache->hits += 1;
+		*size = entry->size;
+		return entry->data;
+	}
+
+	cache->misses += 1;
+
+	if(!(entry = _entry_read(cache, app->io, info, key, gzip)))
+		return NULL;
+
+	_cache_insert(cache, entry);
+
+	*size = entry->size;
+	return entry->data;
+}
+
+static void
+_work(uv_work_t *req)
+{
+	job_t *job = req->data;
+
+	job->entry = _entry_read(job->app->cache, job->io, &job->info, job->key, job->gzip);
+}
+
+static void
+_after_work(uv_work_t *req, int status)
+{
+	job_t *job = req->data;
+	zip_cache_t *cache = job->app->cache;
+	entry_t *entry = job->entry;
+
+	cache->jobs = inlist_remove(cache->jobs, INLIST_GET(job));
+
+	if(job->detached) // Lua state and callback data are gone
+	{
+		if(entry)
+			free(entry);
+		free(job);
+		return;
+	}
+
+	if(status) // canceled
+	{
+		if(entry)
+			free(entry);
+		entry = NULL;
+	}
+	else if(entry && (cache->io != job->io)) // bundle has been reopened meanwhile
+	{
+		free(entry);
+		entry = NULL;
+	}
+	else if(entry)
+	{
+		// concurrent job for same key may have cached it already
+		entry_t *cached = _cache_lookup(cache, job->key, job->gzip);
+		if(cached)
+		{
+			free(entry);
+			entry = cached;
+		}
+		else
+			_cache_insert(cache, entry);
+	}
+
+	if(entry)
+		job->cb(job->app, entry->data, entry->size, job->data);
+	else
+		job->cb(job->app, NULL, 0, job->data);
+
+	free(job);
+}
+
+// get refcounted entry data without blocking the loop, entries missing in cache
+// are read on the threadpool. cb is invoked exactly once with NULL on failure,
+// synchronously on cache hits
+void
+zip_acquire_async(app_t *app, const char *key, int gzip, zip_cb_t cb, void *data)
+{
+	zip_cache_t *cache;
+	entry_t *entry;
+	int err;
+
+	const zip_info_t *info;
+
+	if(!app->io || !(cache = _cache(app)) || !(info = _index_lookup(cache, key)))
+	{
+		cb(app, NULL, 0, data);
+		return;
+	}
+
+	if(!gzip && info->mapped)
+	{
+		cache->map->refs += 1;
+		cache->mapped += 1;
+		cb(app, info->mapped, info->size, data);
+		return;
+	}
+
+	if((entry = _cache_lookup(cache, key, gzip)))
+	{
+		cache->hits += 1;
+		cb(app, entry->data, entry->size, data);
+		return;
+	}
+
+	cache->misses += 1;
+
+	const size_t nkey = strlen(key) + 1;
+	job_t *job = malloc(sizeof(job_t) + nkey);
+	if(!job)
+	{
+		cb(app, NULL, 0, data);
+		return;
+	}
+
+	job->req.data = job;
+	job->app = app;
+	job->io = app->io;
+	job->cb = cb;
+	job->data = data;
+	job->gzip = gzip;
+	job->info = *info;
+	job->entry = NULL;
+	memcpy(job->key, key, nkey);
+
+	if((err = uv_queue_work(app->loop, &job->req, _work, _after_work)))
+	{
+		fprintf(stderr, "uv_queue_work: %s\n", uv_strerror(err));
+		free(job);
+		cb(app, NULL, 0, data);
+		return;
+	}
+
+	cache->jobs = inlist_append(cache->jobs, INLIST_GET(job));
+}
+
+// detach pending asynchronous reads before their callback data is torn down,
+// queued jobs are canceled, running ones complete without invoking callback
+void
+zip_cancel_async(app_t *app)
+{
+	zip_cache_t *cache = app->cache;
+	job_t *job;
+
+	if(!cache)
+		return;
+
+	INLIST_FOREACH(cache->jobs, job)
+	{
+		job->detached = 1;
+		uv_cancel((uv_req_t *)&job->req);
+	}
+}
+
+void
+zip_release(app_t *app, const uint8_t *data)
+{
+	if(app->cache && _map_release(app->cache, data))
+		return;
+
+	entry_t *entry = (entry_t *)(data - offsetof(entry_t, data));
+
+	if( (--entry->refs == 0) && !entry->cached)
+		free(entry);
+}
+
+void
+zip_cache_free(app_t *app)
+{
+	zip_cache_t *cache = app->cache;
+
+	if(cache)
+	{
+		_cache_flush(cache);
+		_index_free(cache);
+		while(cache->maps)
+			_map_free(cache, INLIST_CONTAINER_GET(cache->maps, map_t));
+		uv_mutex_destroy(&cache->mutex);
+		free(cache);
+		app->cache = NULL;
+	}
+}
+
+// look up entry metadata, valid until bundle is reopened
+const zip_info_t *
+zip_info(app_t *app, const char *key)
+{
+	zip_cache_t *cache;
+
+	if(!app->io || !(cache = _cache(app)))
+		return NULL;
+
+	return _index_lookup(cache, key);
+}
+
 static int
 _call(lua_State *L)
 {
@@ -66,12 +880,12 @@ _call(lua_State *L)
 	const char *key = luaL_checkstring(L, 1);
 
 	size_t size;
-	uint8_t *chunk = zip_read(app, key, &size);
+	const uint8_t *chunk = zip_acquire(app, key, &size, 0);
 
 	if(chunk)
 	{
-		lua_pushlstring(L, (char *)chunk, size);
-		free(chunk);
+		lua_pushlstring(L, (const char *)chunk, size);
+		zip_release(app, chunk);
 	}
 	else
 		lua_pushnil(L);
@@ -79,8 +893,288 @@ _call(lua_State *L)
 	return 1;
 }
 
+static void
+_on_read_async(app_t *app, const uint8_t *chunk, size_t size, void *data)
+{
+	lua_State *L = app->L;
+	const int ref = (intptr_t)data;
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, ref);
+	luaL_unref(L, LUA_REGISTRYINDEX, ref);
+
+	if(chunk)
+	{
+		lua_pushlstring(L, (const char *)chunk, size);
+		zip_release(app, chunk);
+	}
+	else
+		lua_pushnil(L);
+
+	if(lua_pcall(L, 1, 0, 0))
+	{
+		fprintf(stderr, "_on_read_async: %s\n", lua_tostring(L, -1));
+		lua_pop(L, 1);
+	}
+}
+
+static int
+_read_async(lua_State *L)
+{
+	app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+
+	const char *key = luaL_checkstring(L, 1);
+	luaL_checktype(L, 2, LUA_TFUNCTION);
+
+	lua_pushvalue(L, 2);
+	const int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+	zip_acquire_async(app, key, 0, _on_read_async, (void *)(intptr_t)ref);
+
+	return 0;
+}
+
+static int
+_stat(lua_State *L)
+{
+	app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+
+	const char *key = luaL_checkstring(L, 1);
+	const zip_info_t *info = zip_info(app, key);
+
+	if(!info)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_createtable(L, 0, 6);
+	{
+		lua_pushinteger(L, info->index);
+		lua_setfield(L, -2, "index");
+
+		lua_pushinteger(L, info->size);
+		lua_setfield(L, -2, "size");
+
+		lua_pushinteger(L, info->comp_size);
+		lua_setfield(L, -2, "comp_size");
+
+		lua_pushinteger(L, info->crc);
+		lua_setfield(L, -2, "crc");
+
+		switch(info->comp_method)
+		{
+			case ZIP_CM_STORE:
+				lua_pushstring(L, "store");
+				break;
+			case ZIP_CM_DEFLATE:
+				lua_pushstring(L, "deflate");
+				break;
+			default:
+				lua_pushinteger(L, info->comp_method);
+				break;
+		}
+		lua_setfield(L, -2, "method");
+
+		lua_pushstring(L, info->mime);
+		lua_setfield(L, -2, "mime");
+	}
+
+	return 1;
+}
+
+// list entry names in archive order, optionally filtered by prefix
+static int
+_list(lua_State *L)
+{
+	app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+	zip_cache_t *cache;
+
+	size_t nprefix = 0;
+	const char *prefix = luaL_optlstring(L, 1, "", &nprefix);
+
+	lua_newtable(L);
+
+	if(!app->io || !(cache = _cache(app)))
+		return 1;
+
+	lua_Integer n = 0;
+	for(size_t i=0; i<cache->nentries; i++)
+	{
+		const char *name = cache->entries[i].name;
+
+		if(strncmp(name, prefix, nprefix))
+			continue;
+
+		lua_pushstring(L, name);
+		lua_rawseti(L, -2, ++n);
+	}
+
+	return 1;
+}
+
+// get entry as referenced blob, stored entries point directly into mapping
+static int
+_blob(lua_State *L)
+{
+	app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+
+	const char *key = luaL_checkstring(L, 1);
+
+	zip_blob_t *blob = lua_newuserdata(L, sizeof(zip_blob_t));
+	blob->data = zip_acquire(app, key, &blob->size, 0);
+	if(!blob->data)
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	luaL_getmetatable(L, "zip_blob_t");
+	lua_setmetatable(L, -2);
+
+	return 1;
+}
+
+// get cache statistics, optionally set new memory budget
+static int
+_cache_stats(lua_State *L)
+{
+	app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+	zip_cache_t *cache = _cache(app);
+
+	if(!cache)
+		return 0;
+
+	if(!lua_isnoneornil(L, 1))
+	{
+		cache->max = luaL_checkinteger(L, 1);
+		_cache_evict(cache, 0);
+	}
+
+	lua_createtable(L, 0, 6);
+	{
+		lua_pushinteger(L, cache->size);
+		lua_setfield(L, -2, "size");
+
+		lua_pushinteger(L, cache->max);
+		lua_setfield(L, -2, "max");
+
+		lua_pushinteger(L, inlist_count(cache->lru));
+		lua_setfield(L, -2, "entries");
+
+		lua_pushinteger(L, cache->hits);
+		lua_setfield(L, -2, "hits");
+
+		lua_pushinteger(L, cache->misses);
+		lua_setfield(L, -2, "misses");
+
+		lua_pushinteger(L, cache->mapped);
+		lua_setfield(L, -2, "mapped");
+	}
+
+	return 1;
+}
+
 static const luaL_Reg lzip [] = {
 	{"read", _call},
+	{"read_async", _read_async},
+	{"stat", _stat},
+	{"blob", _blob},
+	{"list", _list},
+	{"cache", _cache_stats},
+	{NULL, NULL}
+};
+
+static int
+_blob_gc(lua_State *L)
+{
+	app_t *app = lua_touserdata(L, lua_upvalueindex(1));
+	zip_blob_t *blob = luaL_checkudata(L, 1, "zip_blob_t");
+
+	if(blob->data)
+	{
+		zip_release(app, blob->data);
+		blob->data = NULL;
+		blob->size = 0;
+	}
+
+	return 0;
+}
+
+static int
+_blob_len(lua_State *L)
+{
+	zip_blob_t *blob = luaL_checkudata(L, 1, "zip_blob_t");
+
+	lua_pushinteger(L, blob->size);
+
+	return 1;
+}
+
+static int
+_blob_index(lua_State *L)
+{
+	zip_blob_t *blob = luaL_checkudata(L, 1, "zip_blob_t");
+
+	if(lua_type(L, 2) != LUA_TNUMBER)
+	{
+		lua_getmetatable(L, 1);
+		lua_pushvalue(L, 2);
+		lua_rawget(L, -2);
+		return 1;
+	}
+
+	const lua_Integer i = lua_tointeger(L, 2);
+	if( (i > 0) && ((size_t)i <= blob->size) )
+		lua_pushinteger(L, blob->data[i-1]);
+	else
+		lua_pushnil(L);
+
+	return 1;
+}
+
+// copy byte range i..j like string.sub
+static int
+_blob_tostring(lua_State *L)
+{
+	zip_blob_t *blob = luaL_checkudata(L, 1, "zip_blob_t");
+	lua_Integer i = luaL_optinteger(L, 2, 1);
+	lua_Integer j = luaL_optinteger(L, 3, blob->size);
+
+	if(i < 1)
+		i = 1;
+	if(j > (lua_Integer)blob->size)
+		j = blob->size;
+
+	if( (i > j) || !blob->data )
+		lua_pushliteral(L, "");
+	else
+		lua_pushlstring(L, (const char *)blob->data + i - 1, j - i + 1);
+
+	return 1;
+}
+
+// write blob to io file handle without intermediate Lua string
+static int
+_blob_write(lua_State *L)
+{
+	zip_blob_t *blob = luaL_checkudata(L, 1, "zip_blob_t");
+	luaL_Stream *stream = luaL_checkudata(L, 2, LUA_FILEHANDLE);
+
+	if(!stream->closef)
+		return luaL_error(L, "attempt to use a closed file");
+
+	lua_pushboolean(L, fwrite(blob->data, 1, blob->size, stream->f) == blob->size);
+
+	return 1;
+}
+
+static const luaL_Reg lblob [] = {
+	{"__gc", _blob_gc},
+	{"__len", _blob_len},
+	{"__index", _blob_index},
+	{"__tostring", _blob_tostring},
+	{"sub", _blob_tostring},
+	{"write", _blob_write},
 	{NULL, NULL}
 };
 
@@ -89,6 +1183,11 @@ luaopen_zip(app_t *app)
 {
 	lua_State *L = app->L;
 
+	luaL_newmetatable(L, "zip_blob_t");
+	lua_pushlightuserdata(L, app);
+	luaL_setfuncs(L, lblob, 1);
+	lua_pop(L, 1);
+
 	lua_newtable(L);
 	lua_pushlightuserdata(L, app);
 	luaL_setfuncs(L, lzip, 1);